@@ -6,6 +6,42 @@
 #include <exception>
 #include <iostream>
 #include <clocale>
+#include <limits>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <complex>
+#include <functional>
+#include <unordered_map>
+#include <memory>
+#include <chrono>
+#include <future>
+#include <cstring>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <list>
+#include <tuple>
+#include <type_traits>
+#include <cstdlib>
+#include <cerrno>
+#include <new>
+#include <random>
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <unistd.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <dlfcn.h>
+#endif
 
 /**
  * Ошибка со статическим текстом.
@@ -20,435 +56,8285 @@ public:
 };
 
 /**
- * Функция.
+ * Интервал [lo;hi] для интервальной арифметики.
+ * Границы результатов операций округляются наружу,
+ * поэтому истинное значение всегда лежит внутри интервала.
  */
-class Function
+class Interval
 {
-    std::string     name;
+public:
+    double  lo; // нижняя граница
+    double  hi; // верхняя граница
 
-protected:
+    Interval() : lo(0.0), hi(0.0) {}
+    Interval(double v) : lo(v), hi(v) {}
+    Interval(double l, double h) : lo(l), hi(h) {}
 
-    Function(const char* text) :
-        name(std::string("y = ") + std::string(text))
+    double width() const { return hi - lo; }
+    double mid() const { return lo + (hi - lo) / 2; }
+    bool contains(double v) const { return (lo <= v) && (v <= hi); }
+
+    /**
+     * Округление вниз/вверх на один ulp.
+     */
+    static double down(double v)
+    {
+        return std::nextafter(v, -std::numeric_limits<double>::infinity());
+    }
+    static double up(double v)
+    {
+        return std::nextafter(v, std::numeric_limits<double>::infinity());
+    }
+    /**
+     * Наименьший интервал, содержащий оба интервала.
+     */
+    static Interval hull(const Interval& a, const Interval& b)
     {
+        return Interval(std::min(a.lo, b.lo), std::max(a.hi, b.hi));
     }
 
+    friend Interval operator+(const Interval& a, const Interval& b)
+    {
+        return Interval(down(a.lo + b.lo), up(a.hi + b.hi));
+    }
+    friend Interval operator-(const Interval& a, const Interval& b)
+    {
+        return Interval(down(a.lo - b.hi), up(a.hi - b.lo));
+    }
+    friend Interval operator-(const Interval& a)
+    {
+        return Interval(-a.hi, -a.lo);
+    }
+    friend Interval operator*(const Interval& a, const Interval& b)
+    {
+        double p1 = a.lo * b.lo, p2 = a.lo * b.hi;
+        double p3 = a.hi * b.lo, p4 = a.hi * b.hi;
+        return Interval(down(std::min(std::min(p1, p2), std::min(p3, p4))),
+            up(std::max(std::max(p1, p2), std::max(p3, p4))));
+    }
     /**
-     * Собственно значение функции, переопределить в наследниках.
+     * Квадрат (уже, чем a * a, если интервал содержит 0).
      */
-    virtual double f(double x) const = 0;
+    friend Interval sqr(const Interval& a)
+    {
+        double l = a.lo * a.lo, h = a.hi * a.hi;
+        if (a.contains(0.0))
+            return Interval(0.0, up(std::max(l, h)));
+        return Interval(down(std::min(l, h)), up(std::max(l, h)));
+    }
+    /**
+     * Синус: на концах плюс экстремумы, попавшие внутрь.
+     */
+    friend Interval sin(const Interval& a)
+    {
+        const double pi = 3.14159265358979323846;
+        if (!(a.width() < 2 * pi))
+            return Interval(-1.0, 1.0);
+        double s1 = std::sin(a.lo), s2 = std::sin(a.hi);
+        double l = down(down(std::min(s1, s2)));
+        double h = up(up(std::max(s1, s2)));
+        // ближайшие к a.lo справа точки максимума (pi/2 + 2pi*k)
+        // и минимума (-pi/2 + 2pi*k); проверяем с запасом.
+        double kmax = std::ceil((a.lo - pi / 2) / (2 * pi) - 1e-12);
+        if (pi / 2 + 2 * pi * kmax <= a.hi + 1e-12) h = 1.0;
+        double kmin = std::ceil((a.lo + pi / 2) / (2 * pi) - 1e-12);
+        if (-pi / 2 + 2 * pi * kmin <= a.hi + 1e-12) l = -1.0;
+        return Interval(std::max(l, -1.0), std::min(h, 1.0));
+    }
+};
 
+/**
+ * Число двойной-двойной точности (double-double): неоценённая сумма
+ * hi + lo двух double, около 32 значащих десятичных цифр.
+ */
+class DoubleDouble
+{
 public:
+    double  hi; // старшая часть
+    double  lo; // младшая часть, |lo| <= ulp(hi) / 2
+
+    DoubleDouble() : hi(0.0), lo(0.0) {}
+    explicit DoubleDouble(double v) : hi(v), lo(0.0) {}
+    DoubleDouble(double h, double l) : hi(h), lo(l) {}
 
     /**
-     * Значение функции в точке x.
+     * Точная сумма двух double: s + e == a + b.
      */
-    double calcValue(double x) const
+    static DoubleDouble twoSum(double a, double b)
     {
-        return f(x);
+        double s = a + b;
+        double bb = s - a;
+        return DoubleDouble(s, (a - (s - bb)) + (b - bb));
     }
     /**
-     * Значение производной в точке x с точностью eps.
+     * То же при |a| >= |b|.
      */
-    double calcDerivation(double x, double eps) const
+    static DoubleDouble quickTwoSum(double a, double b)
     {
-        double dx = eps / 10.0;
-        return (f(x + dx) - f(x)) / dx;
+        double s = a + b;
+        return DoubleDouble(s, b - (s - a));
     }
     /**
-     * Имя функции.
+     * Точное произведение двух double.
      */
-    const std::string& getName() const
+    static DoubleDouble twoProd(double a, double b)
     {
-        return name;
+        double p = a * b;
+        return DoubleDouble(p, std::fma(a, b, -p));
+    }
+
+    friend DoubleDouble operator+(const DoubleDouble& a, const DoubleDouble& b)
+    {
+        DoubleDouble s = twoSum(a.hi, b.hi);
+        DoubleDouble t = twoSum(a.lo, b.lo);
+        s.lo += t.hi;
+        s = quickTwoSum(s.hi, s.lo);
+        s.lo += t.lo;
+        return quickTwoSum(s.hi, s.lo);
+    }
+    friend DoubleDouble operator-(const DoubleDouble& a)
+    {
+        return DoubleDouble(-a.hi, -a.lo);
+    }
+    friend DoubleDouble operator-(const DoubleDouble& a, const DoubleDouble& b)
+    {
+        return a + (-b);
+    }
+    friend DoubleDouble operator*(const DoubleDouble& a, const DoubleDouble& b)
+    {
+        DoubleDouble p = twoProd(a.hi, b.hi);
+        p.lo += a.hi * b.lo + a.lo * b.hi;
+        return quickTwoSum(p.hi, p.lo);
+    }
+    friend DoubleDouble operator/(const DoubleDouble& a, const DoubleDouble& b)
+    {
+        double q1 = a.hi / b.hi;
+        DoubleDouble r = a - b * DoubleDouble(q1);
+        double q2 = r.hi / b.hi;
+        r = r - b * DoubleDouble(q2);
+        double q3 = r.hi / b.hi;
+        return quickTwoSum(q1, q2) + DoubleDouble(q3);
+    }
+    friend bool operator<(const DoubleDouble& a, const DoubleDouble& b)
+    {
+        return (a.hi < b.hi) || ((a.hi == b.hi) && (a.lo < b.lo));
+    }
+    friend bool operator>(const DoubleDouble& a, const DoubleDouble& b) { return b < a; }
+    friend bool operator<=(const DoubleDouble& a, const DoubleDouble& b) { return !(b < a); }
+    friend bool operator>=(const DoubleDouble& a, const DoubleDouble& b) { return !(a < b); }
+    friend DoubleDouble fabs(const DoubleDouble& a)
+    {
+        return a.hi < 0 ? -a : a;
+    }
+    /**
+     * Запись с digits знаками после запятой.
+     */
+    std::string toString(int digits) const
+    {
+        std::ostringstream oss;
+        DoubleDouble v = *this;
+        if (v.hi < 0) {
+            oss << '-';
+            v = -v;
+        }
+        // округление: прибавляем половину последнего разряда
+        DoubleDouble half(0.5);
+        for (int i = 0; i < digits; ++i) half = half / DoubleDouble(10.0);
+        v = v + half;
+        double ip = std::floor(v.hi);
+        if ((ip == v.hi) && (v.lo < 0)) ip -= 1;
+        DoubleDouble frac = v - DoubleDouble(ip);
+        oss << std::fixed << std::setprecision(0) << ip;
+        if (digits > 0) oss << '.';
+        for (int i = 0; i < digits; ++i) {
+            frac = frac * DoubleDouble(10.0);
+            double d = std::floor(frac.hi);
+            if ((d == frac.hi) && (frac.lo < 0)) d -= 1;
+            d = std::min(9.0, std::max(0.0, d));
+            frac = frac - DoubleDouble(d);
+            oss << int(d);
+        }
+        return oss.str();
     }
 };
 
+#if defined(__SIZEOF_FLOAT128__) && !defined(__clang__)
+#define HAVE_FLOAT128
 /**
- * Функция y = x^2
+ * Четверная точность (__float128 GCC), около 34 десятичных цифр.
  */
-class Square : public Function
+typedef __float128 Quad;
+#endif
+
+/**
+ * Свойства вещественных типов для шаблонных вычислений.
+ */
+template< class T > struct Real;
+
+template<> struct Real<double>
 {
-public:
-    Square() : Function("x^2") {}
-protected:
-    virtual double f(double x) const
+    static double pi() { return 3.14159265358979323846; }
+    static double eps() { return 1.1102230246251565e-16; }
+    static double toDouble(double v) { return v; }
+    static double fromDouble(double v) { return v; }
+    static int digits() { return 15; }
+    static std::string toString(double v, int prec)
     {
-        return x * x;
+        std::ostringstream oss;
+        oss << std::fixed << std::setprecision(prec) << v;
+        return oss.str();
     }
 };
 
-/**
- * Функция y = sin(x)
- */
-class Sin : public Function
+template<> struct Real<DoubleDouble>
 {
-public:
-    Sin() : Function("sin(x)") {}
-protected:
-    virtual double f(double x) const
+    static DoubleDouble pi()
     {
-        return sin(x);
+        return DoubleDouble(3.141592653589793116, 1.2246467991473532e-16);
+    }
+    static DoubleDouble eps() { return DoubleDouble(4.93038065763132e-32); }
+    static double toDouble(const DoubleDouble& v) { return v.hi; }
+    static DoubleDouble fromDouble(double v) { return DoubleDouble(v); }
+    static int digits() { return 30; }
+    static std::string toString(const DoubleDouble& v, int prec)
+    {
+        return v.toString(prec);
+    }
+};
+
+#ifdef HAVE_FLOAT128
+template<> struct Real<Quad>
+{
+    static Quad pi()
+    {
+        return Quad(3.141592653589793116) + Quad(1.2246467991473532e-16)
+            + Quad(-2.9947698097183397e-33);
+    }
+    static Quad eps() { return Quad(1.0) / Quad(5.192296858534828e33); }
+    static double toDouble(Quad v) { return double(v); }
+    static Quad fromDouble(double v) { return Quad(v); }
+    static int digits() { return 33; }
+    static std::string toString(Quad v, int prec)
+    {
+        double h = double(v);
+        return DoubleDouble(h, double(v - Quad(h))).toString(prec);
     }
 };
+#endif
+
+/**
+ * Квадратный корень для типов повышенной точности: шаг Ньютона от
+ * приближения в double.
+ */
+template< class T > T sqrtT(const T& v)
+{
+    typedef Real<T> R;
+    T r = R::fromDouble(std::sqrt(R::toDouble(v)));
+    for (int i = 0; i < 2; ++i)
+        r = (r + v / r) / R::fromDouble(2.0);
+    return r;
+}
+
+/**
+ * Синус для типов повышенной точности: приведение к [-pi/2;pi/2] и ряд
+ * Тейлора до точности типа.
+ */
+template< class T > T sinT(const T& arg)
+{
+    typedef Real<T> R;
+    T pi = R::pi();
+    T twoPi = pi * R::fromDouble(2.0);
+    double k = std::floor(R::toDouble(arg / twoPi) + 0.5);
+    T x = arg - twoPi * R::fromDouble(k);
+    T halfPi = pi / R::fromDouble(2.0);
+    if (x > halfPi) x = pi - x;
+    else if (x < -halfPi) x = -pi - x;
+    T x2 = x * x;
+    T term = x;
+    T sum = x;
+    for (int n = 1; n < 60; ++n) {
+        term = term * (-x2) / R::fromDouble(double(2 * n) * (2 * n + 1));
+        sum = sum + term;
+        if (fabs(R::toDouble(term))
+            <= fabs(R::toDouble(sum)) * R::toDouble(R::eps()))
+            break;
+    }
+    return sum;
+}
+
+#ifdef COUNT_ALLOCATIONS
+/**
+ * Кол-во выделений памяти в куче за время работы (для тестов
+ * производительности): глобальный operator new заменён счётчиком.
+ * Только в сборке с COUNT_ALLOCATIONS - иначе каждое выделение
+ * платило бы за атомарное увеличение.
+ */
+static std::atomic<uint64_t> heapAllocations(0);
+
+void* operator new(size_t size)
+{
+    heapAllocations.fetch_add(1, std::memory_order_relaxed);
+    if (size == 0) size = 1;
+    // как у стандартного operator new: при нехватке памяти вызывается
+    // установленный обработчик, без него - bad_alloc
+    while (true) {
+        if (void* p = std::malloc(size))
+            return p;
+        std::new_handler handler = std::get_new_handler();
+        if (!handler)
+            throw std::bad_alloc();
+        handler();
+    }
+}
+// освобождение не встраивается: иначе GCC видит free() для памяти
+// из operator new и ошибочно предупреждает о несоответствии
+#if defined(__GNUC__)
+__attribute__((noinline))
+#endif
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+void operator delete(void* p, size_t) noexcept
+{
+    operator delete(p);
+}
+// остальные формы - через две основные, чтобы память всегда
+// выделялась и освобождалась одной парой функций
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    try {
+        return operator new(size);
+    }
+    catch (...) {
+        return nullptr;
+    }
+}
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+void* operator new[](size_t size, const std::nothrow_t& tag) noexcept
+{
+    return operator new(size, tag);
+}
+void operator delete(void* p, const std::nothrow_t&) noexcept
+{
+    operator delete(p);
+}
+void operator delete[](void* p) noexcept
+{
+    operator delete(p);
+}
+void operator delete[](void* p, size_t) noexcept
+{
+    operator delete(p);
+}
+void operator delete[](void* p, const std::nothrow_t&) noexcept
+{
+    operator delete(p);
+}
+#endif
 
 /**
- * Набор функций
+ * Арена: память выдаётся сдвигом указателя внутри больших блоков и
+ * освобождается только вся сразу - при удалении арены или откате к
+ * отметке (блоки после отметки тогда используются повторно).
  */
-class Functions
+class Arena
 {
-    Square                          square_func;
-    Sin                             sin_func;
-    std::vector<const Function*>    functions;
-    using Iter = std::vector<const Function*>::iterator;
+    struct Block
+    {
+        Block*  next;
+        size_t  size;   // байт данных после заголовка
+    };
+
+    Block*  first;      // все блоки
+    Block*  block;      // текущий блок
+    size_t  used;       // занято байт в текущем блоке
+    size_t  blockSize;  // размер нового блока
+    size_t  reserved;   // байт во всех блоках
+
+    static char* data(Block* b)
+    {
+        return reinterpret_cast<char*>(b + 1);
+    }
 
 public:
+    /**
+     * Отметка для отката.
+     */
+    struct Mark
+    {
+        Block*  block;
+        size_t  used;
+    };
+    /**
+     * Откат арены к отметке при выходе из области видимости
+     * (без арены - ничего).
+     */
+    class Scope
+    {
+        Arena*  arena;
+        Mark    mark;
+
+    public:
+        explicit Scope(Arena* a) : arena(a), mark(a ? a->getMark() : Mark()) {}
+        ~Scope() { if (arena) arena->rewind(mark); }
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+    };
 
-    Functions() : square_func(), sin_func(), functions()
+    explicit Arena(size_t size = 4096) :
+        first(nullptr), block(nullptr), used(0), blockSize(size), reserved(0)
+    {
+    }
+    ~Arena()
     {
-        functions.push_back(&square_func);
-        functions.push_back(&sin_func);
+        while (first) {
+            Block* next = first->next;
+            ::operator delete(first);
+            first = next;
+        }
     }
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
     /**
-     * Функция по индексу.
+     * Выделение bytes байт с выравниванием align (не больше, чем у
+     * operator new).
      */
-    const Function& get(int index) const
+    void* allocate(size_t bytes, size_t align)
     {
-        int fsize = functions.size();
-        if ((index < 0) || (index >= fsize))
-            throw MyError("Неверный индекс функции");
-        return *functions.at(index);
+        if (block) {
+            size_t at = (used + align - 1) & ~(align - 1);
+            if (at + bytes <= block->size) {
+                used = at + bytes;
+                return data(block) + at;
+            }
+        }
+        // следующий блок: уже выделенный, если подходит, иначе новый
+        Block*& link = block ? block->next : first;
+        Block* next = link;
+        if (!next || (next->size < bytes)) {
+            size_t size = std::max(blockSize, bytes);
+            next = static_cast<Block*>(::operator new(sizeof(Block) + size));
+            next->next = link;
+            next->size = size;
+            link = next;
+            reserved += size;
+        }
+        block = next;
+        used = bytes;
+        return data(block);
+    }
+    Mark getMark() const
+    {
+        Mark m = { block, used };
+        return m;
+    }
+    void rewind(const Mark& m)
+    {
+        block = m.block;
+        used = m.used;
     }
+    size_t getReserved() const { return reserved; }
     /**
-     * Кол-во функций.
+     * Временная арена потока для промежуточных данных (с откатом
+     * через Scope).
      */
-    int getSize() const
+    static Arena& scratch()
     {
-        return functions.size();
+        static thread_local Arena arena(64 * 1024);
+        return arena;
     }
 };
 
 /**
- * Данные для решения задачи.
+ * Распределитель памяти контейнеров из арены; без арены - обычная
+ * куча. Копия контейнера всегда в куче: она может пережить арену.
  */
-class Problem
+template <typename T> class ArenaAllocator
 {
-    int         iterations; // кол-во итераций
-    int         precision;  // точность (знаков).
-    double      epsilon;    // точность вычислений (epsilon).
-    double      left;       // левый конец отрезка, содержащего минимум
-    double      right;      // правый конец отрезка, содержащего минимум
-    long double      x;          // найденный минимум
+    template <typename U> friend class ArenaAllocator;
 
+    Arena* arena;
 
 public:
+    typedef T value_type;
 
-    static const int ITERATION_LIMIT = 10000; // предел кол-ва итераций
-
-    Problem() :
-        iterations(0),
-        precision(5),
-        epsilon(pow(10, -precision)),
-        left(-1.0),
-        right(1.0),
-        x(0.0)
+    ArenaAllocator() : arena(nullptr) {}
+    explicit ArenaAllocator(Arena* a) : arena(a) {}
+    template <typename U> ArenaAllocator(const ArenaAllocator<U>& other) :
+        arena(other.arena)
     {
     }
-
-private:
-
-    /**
-     * Значение производной функции f в точке x
-     */
-    double dfdx(const Function& f, double x) const
+    T* allocate(size_t n)
     {
-        return f.calcDerivation(x, precision);
+        if (!arena)
+            return static_cast<T*>(::operator new(n * sizeof(T)));
+        return static_cast<T*>(arena->allocate(n * sizeof(T), alignof(T)));
     }
-    /**
-     * Имеет ли функция минимум  на отрезке [left;right].
-     */
-    bool hasMinimum(const Function& f) const
+    void deallocate(T* p, size_t)
+    {
+        if (!arena)
+            ::operator delete(p);
+    }
+    ArenaAllocator select_on_container_copy_construction() const
+    {
+        return ArenaAllocator();
+    }
+    template <typename U> bool operator==(const ArenaAllocator<U>& other) const
+    {
+        return arena == other.arena;
+    }
+    template <typename U> bool operator!=(const ArenaAllocator<U>& other) const
     {
-        return (f.calcDerivation(left, precision) < 0)
-            && (f.calcDerivation(right, precision) > 0);
+        return arena != other.arena;
     }
+};
 
+/**
+ * Разобранное выражение от x и параметра p: дерево, узлы которого
+ * хранятся в одном векторе (потомки раньше родителя, корень - последний).
+ *   сумма     = слагаемое { ("+" | "-") слагаемое }
+ *   слагаемое = множитель { ("*" | "/") множитель }
+ *   множитель = "-" множитель | степень
+ *   степень   = операнд [ "^" множитель ]
+ *   операнд   = число | "x" | "p" | функция "(" сумма ")" | "(" сумма ")"
+ * Функции: sin, cos, tan, exp, log, sqrt, abs.
+ * Узлы могут храниться в арене (тогда она должна пережить выражение).
+ */
+class Expression
+{
 public:
+    enum Op {
+        OP_CONST, OP_X, OP_P,
+        OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_POW,
+        OP_NEG, OP_SQR, OP_SIN, OP_COS, OP_TAN, OP_EXP, OP_LOG, OP_SQRT, OP_ABS,
+        // только в скомпилированной программе
+        OP_SINCOS, OP_COSSIN, OP_DONE
+    };
+    struct Node
+    {
+        Op      op;     // операция
+        int     a, b;   // номера операндов (-1 - нет)
+        double  value;  // значение константы
+    };
 
-    double getLeft() const { return left; }
-    double getRight() const { return right; }
-    int getPrecision() const { return precision; }
-    double getEpsilon() const { return epsilon; }
-    int getIterations() const { return iterations; }
     /**
-     * Установка границ отрезка.
+     * Поиск выражения другой функции по имени (для вызова name(...)
+     * внутри выражения) или nullptr.
      */
-    void setBounds(double a, double b)
+    using Resolver = std::function<const Expression*(const std::string&)>;
+    typedef std::vector<Node, ArenaAllocator<Node>> Nodes;
+
+private:
+    typedef std::vector<int, ArenaAllocator<int>> Indices;
+
+    Nodes               nodes;  // узлы дерева
+    const char*         pos;    // текущий символ при разборе
+    Resolver            resolve;// поиск других функций
+
+    explicit Expression(Arena* arena = nullptr) :
+        nodes(ArenaAllocator<Node>(arena)), pos(nullptr), resolve()
     {
-        left = a < b ? a : b;
-        right = a < b ? b : a;
     }
     /**
-     * Установка точности.
+     * Число из текста [from;to) с точкой независимо от локали. Если
+     * мантисса (до 15 цифр) и степень десяти (до 22) точны в double,
+     * результат - одно точное умножение или деление (он округлён
+     * верно и без выделения памяти), иначе число читает поток.
      */
-    void setPrecision(int prec)
+    static bool number(const char* from, const char* to, double& v)
     {
-        precision = prec;
-        epsilon = pow(10, -precision);
+        static const double POW10[] = {
+            1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+            1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+        };
+        uint64_t mant = 0;
+        int digits = 0, scale = 0, points = 0, seen = 0;
+        const char* p = from;
+        for (; (p < to) && (isdigit((unsigned char)*p) || (*p == '.')); ++p) {
+            if (*p == '.') {
+                ++points;
+                continue;
+            }
+            mant = mant * 10 + (*p - '0');
+            ++seen;
+            if (mant) ++digits;
+            if (points) --scale;
+        }
+        if (p < to) {
+            bool neg = *++p == '-';
+            if ((*p == '-') || (*p == '+')) ++p;
+            int e = 0;
+            for (; (p < to) && (e < 1000); ++p)
+                e = e * 10 + (*p - '0');
+            scale += neg ? -e : e;
+        }
+        if ((points <= 1) && seen && (digits <= 15) && (p == to)
+            && (scale >= -22) && (scale <= 22)) {
+            v = scale < 0 ? double(mant) / POW10[-scale] : double(mant) * POW10[scale];
+            return true;
+        }
+        std::istringstream iss(std::string(from, to));
+        iss.imbue(std::locale::classic());
+        iss >> v;
+        return !iss.fail() && iss.eof();
     }
-    /**
-     * Строка с отрезком.
-     */
-    std::string getBoundsString() const
+
+    int node(Op op, int a = -1, int b = -1, double value = 0.0)
     {
-        std::ostringstream oss;
-        oss << std::fixed << std::setprecision(precision)
-            << '[' << left << ';' << right << ']';
-        return oss.str();
+        Node n = { op, a, b, value };
+        nodes.push_back(n);
+        return nodes.size() - 1;
     }
-    /**
-     * Строка с точностью.
-     */
-    std::string getPrecisionString() const
+    void skip()
     {
-        std::ostringstream oss;
-        oss << precision << " знаков после запятой ("
-            << std::fixed << std::setprecision(precision)
-            << epsilon << ")";
-        return oss.str();
+        while (isspace((unsigned char)*pos)) ++pos;
     }
-    /**
-     * Строка с решением.
-     */
-    std::string getSolutionString() const
+    bool accept(char c)
     {
-        std::ostringstream oss;
-        oss << "Минимум: " << x << " (найден за " << iterations << " итераций)";
-        return oss.str();
+        skip();
+        if (*pos != c) return false;
+        ++pos;
+        return true;
     }
-    /**
-     * Поиск минимума.
-     * Бросает исключения при всяких ошибках.
+    int sum()
+    {
+        int a = term();
+        while (true) {
+            if (accept('+')) a = node(OP_ADD, a, term());
+            else if (accept('-')) a = node(OP_SUB, a, term());
+            else return a;
+        }
+    }
+    int term()
+    {
+        int a = factor();
+        while (true) {
+            if (accept('*')) a = node(OP_MUL, a, factor());
+            else if (accept('/')) a = node(OP_DIV, a, factor());
+            else return a;
+        }
+    }
+    int factor()
+    {
+        if (accept('-')) return node(OP_NEG, factor());
+        int a = operand();
+        if (accept('^')) return node(OP_POW, a, factor());
+        return a;
+    }
+    int operand()
+    {
+        skip();
+        if (accept('(')) {
+            int a = sum();
+            if (!accept(')'))
+                throw MyError("Ошибка в выражении: ожидается ')'");
+            return a;
+        }
+        if (isdigit((unsigned char)*pos) || (*pos == '.')) {
+            const char* from = pos;
+            while (isdigit((unsigned char)*pos) || (*pos == '.')) ++pos;
+            if (((*pos == 'e') || (*pos == 'E')) && (isdigit((unsigned char)pos[1])
+                || (((pos[1] == '-') || (pos[1] == '+')) && isdigit((unsigned char)pos[2])))) {
+                pos += 2;
+                while (isdigit((unsigned char)*pos)) ++pos;
+            }
+            double v;
+            if (!number(from, pos, v))
+                throw MyError("Ошибка в выражении: неверное число");
+            return node(OP_CONST, -1, -1, v);
+        }
+        const char* from = pos;
+        while (isalpha((unsigned char)*pos)) ++pos;
+        std::string name(from, pos);
+        if (name == "x") return node(OP_X);
+        if (name == "p") return node(OP_P);
+        if (name == "pi") return node(OP_CONST, -1, -1, 3.14159265358979323846);
+        static const struct { const char* name; Op op; } FUNCS[] = {
+            { "sin", OP_SIN }, { "cos", OP_COS }, { "tan", OP_TAN },
+            { "exp", OP_EXP }, { "log", OP_LOG }, { "sqrt", OP_SQRT },
+            { "abs", OP_ABS }
+        };
+        for (const auto& fn : FUNCS) {
+            if (name != fn.name) continue;
+            if (!accept('('))
+                throw MyError("Ошибка в выражении: ожидается '('");
+            int a = sum();
+            if (!accept(')'))
+                throw MyError("Ошибка в выражении: ожидается ')'");
+            return node(fn.op, a);
+        }
+        // вызов другой функции подставляет её выражение
+        const Expression* callee = resolve && !name.empty() ? resolve(name) : nullptr;
+        if (callee) {
+            if (!accept('('))
+                throw MyError("Ошибка в выражении: ожидается '('");
+            int a = sum();
+            if (!accept(')'))
+                throw MyError("Ошибка в выражении: ожидается ')'");
+            return append(*callee, a);
+        }
+        throw MyError(name.empty() ? "Ошибка в выражении: ожидается операнд"
+            : "Ошибка в выражении: неизвестное имя");
+    }
+    /**
+     * Копирование дерева e с подстановкой узла x вместо переменной x
+     * (x < 0 - без подстановки). Возвращает номер корня копии.
+     */
+    int append(const Expression& e, int x)
+    {
+        std::vector<int> map(e.nodes.size());
+        for (size_t i = 0; i < e.nodes.size(); ++i) {
+            const Node& n = e.nodes[i];
+            if ((n.op == OP_X) && (x >= 0))
+                map[i] = x;
+            else
+                map[i] = node(n.op, n.a < 0 ? -1 : map[n.a],
+                    n.b < 0 ? -1 : map[n.b], n.value);
+        }
+        return map.back();
+    }
+    /**
+     * Операция с упрощением 0 и 1 (иначе производные быстро
+     * разрастаются из-за умножений на производную x).
+     */
+    int make(Op op, int a, int b = -1)
+    {
+        bool ca = (a >= 0) && (nodes[a].op == OP_CONST);
+        bool cb = (b >= 0) && (nodes[b].op == OP_CONST);
+        double va = ca ? nodes[a].value : 0.0;
+        double vb = cb ? nodes[b].value : 0.0;
+        switch (op) {
+        case OP_ADD:
+            if (ca && (va == 0)) return b;
+            if (cb && (vb == 0)) return a;
+            break;
+        case OP_SUB:
+            if (cb && (vb == 0)) return a;
+            if (ca && (va == 0)) return make(OP_NEG, b);
+            break;
+        case OP_MUL:
+            if ((ca && (va == 0)) || (cb && (vb == 0))) return node(OP_CONST);
+            if (ca && (va == 1)) return b;
+            if (cb && (vb == 1)) return a;
+            break;
+        case OP_DIV:
+            if (ca && (va == 0)) return node(OP_CONST);
+            if (cb && (vb == 1)) return a;
+            break;
+        case OP_POW:
+            if (cb && (vb == 1)) return a;
+            if (cb && (vb == 0)) return node(OP_CONST, -1, -1, 1.0);
+            break;
+        case OP_NEG:
+            if (ca) return node(OP_CONST, -1, -1, -va);
+            break;
+        default:
+            break;
+        }
+        return node(op, a, b);
+    }
+    /**
+     * Производная узла i по x: новые узлы добавляются в конец дерева и
+     * ссылаются на уже существующие. memo - найденные производные узлов.
+     */
+    int derive(int i, Indices& memo)
+    {
+        if (memo.size() < nodes.size())
+            memo.resize(nodes.size(), -1);
+        if (memo[i] >= 0)
+            return memo[i];
+        const Node n = nodes[i];    // копия: вектор узлов растёт
+        int da = n.a >= 0 ? derive(n.a, memo) : -1;
+        int db = n.b >= 0 ? derive(n.b, memo) : -1;
+        int two = -1;
+        int d;
+        switch (n.op) {
+        case OP_X:
+            d = node(OP_CONST, -1, -1, 1.0);
+            break;
+        case OP_ADD:
+        case OP_SUB:
+            d = make(n.op, da, db);
+            break;
+        case OP_MUL:
+            d = make(OP_ADD, make(OP_MUL, da, n.b), make(OP_MUL, n.a, db));
+            break;
+        case OP_DIV:
+            d = make(OP_DIV, make(OP_SUB, make(OP_MUL, da, n.b), make(OP_MUL, n.a, db)),
+                make(OP_SQR, n.b));
+            break;
+        case OP_POW:
+            if (nodes[n.b].op == OP_CONST) {
+                double k = nodes[n.b].value;
+                d = make(OP_MUL, make(OP_MUL, node(OP_CONST, -1, -1, k),
+                    make(OP_POW, n.a, node(OP_CONST, -1, -1, k - 1))), da);
+            }
+            else {
+                d = make(OP_MUL, i, make(OP_ADD, make(OP_MUL, db, make(OP_LOG, n.a)),
+                    make(OP_DIV, make(OP_MUL, n.b, da), n.a)));
+            }
+            break;
+        case OP_NEG:
+            d = make(OP_NEG, da);
+            break;
+        case OP_SQR:
+            two = node(OP_CONST, -1, -1, 2.0);
+            d = make(OP_MUL, make(OP_MUL, two, n.a), da);
+            break;
+        case OP_SIN:
+            d = make(OP_MUL, make(OP_COS, n.a), da);
+            break;
+        case OP_COS:
+            d = make(OP_NEG, make(OP_MUL, make(OP_SIN, n.a), da));
+            break;
+        case OP_TAN:
+            d = make(OP_DIV, da, make(OP_SQR, make(OP_COS, n.a)));
+            break;
+        case OP_EXP:
+            d = make(OP_MUL, i, da);
+            break;
+        case OP_LOG:
+            d = make(OP_DIV, da, n.a);
+            break;
+        case OP_SQRT:
+            two = node(OP_CONST, -1, -1, 2.0);
+            d = make(OP_DIV, da, make(OP_MUL, two, i));
+            break;
+        case OP_ABS:
+            d = make(OP_MUL, da, make(OP_DIV, n.a, i));
+            break;
+        default:    // константы и параметр
+            d = node(OP_CONST);
+            break;
+        }
+        if (memo.size() < nodes.size())
+            memo.resize(nodes.size(), -1);
+        return memo[i] = d;
+    }
+
+public:
+
+    Expression(const std::string& text, const Resolver& resolver = Resolver(),
+        Arena* arena = nullptr) :
+        nodes(ArenaAllocator<Node>(arena)), pos(text.c_str()), resolve(resolver)
+    {
+        // узлов обычно не больше, чем половина символов текста
+        nodes.reserve(text.size() / 2 + 1);
+        sum();
+        skip();
+        if (*pos)
+            throw MyError("Ошибка в выражении: лишние символы");
+        pos = nullptr;
+        resolve = Resolver();
+    }
+    /**
+     * Копия выражения e с узлами в арене arena.
+     */
+    Expression(const Expression& e, Arena* arena) :
+        nodes(e.nodes.begin(), e.nodes.end(), ArenaAllocator<Node>(arena)),
+        pos(nullptr), resolve()
+    {
+    }
+    /**
+     * Константа.
+     */
+    static Expression constant(double value)
+    {
+        Expression e;
+        e.node(OP_CONST, -1, -1, value);
+        return e;
+    }
+    /**
+     * Двуместная операция над выражениями a и b.
+     */
+    static Expression combine(Op op, const Expression& a, const Expression& b)
+    {
+        Expression e;
+        int l = e.append(a, -1);
+        int r = e.append(b, -1);
+        e.node(op, l, r);
+        return e;
+    }
+    /**
+     * Композиция outer(inner(x)).
+     */
+    static Expression compose(const Expression& outer, const Expression& inner)
+    {
+        Expression e;
+        e.append(outer, e.append(inner, -1));
+        return e;
+    }
+    /**
+     * Выражение вместе с первой и второй производными по x: узлы
+     * производных добавляются к копии e и ссылаются на её узлы, так что
+     * общие части (например, sin и cos одного аргумента) программа
+     * вычислит один раз. В roots - корни f, f' и f''; узлы - в арене
+     * arena, если она задана.
+     */
+    static Expression differentiate(const Expression& e, int roots[3],
+        Arena* arena = nullptr)
+    {
+        Expression d(e, arena);
+        Indices memo{ ArenaAllocator<int>(arena) };
+        roots[0] = d.nodes.size() - 1;
+        roots[1] = d.derive(roots[0], memo);
+        roots[2] = d.derive(roots[1], memo);
+        return d;
+    }
+    const Nodes& getNodes() const { return nodes; }
+    /**
+     * Есть ли в выражении параметр p.
+     */
+    bool usesParam() const
+    {
+        for (const Node& n : nodes)
+            if (n.op == OP_P) return true;
+        return false;
+    }
+    /**
+     * Кол-во операндов операции.
+     */
+    static int arity(Op op)
+    {
+        return op <= OP_P ? 0 : op <= OP_POW ? 2 : 1;
+    }
+};
+
+/**
+ * Векторизуемые ядра для грубых вычислений в float: цикл по точкам без
+ * ветвлений и вызовов библиотечных функций, так что компилятор может
+ * считать несколько точек одной командой SIMD.
+ */
+struct LaneMath
+{
+    /**
+     * sin(x + shift*pi/2) в n точках. Аргумент приводится к [-pi/4;pi/4]
+     * в double, синус и косинус остатка - отрезки ряда Тейлора (ошибка
+     * меньше 2e-9, ниже точности float). Точки с |x| > 1e5 и NaN
+     * считаются отдельно через std::sin и std::cos.
+     */
+    static void sin(const float* xs, float* ys, size_t n, int shift = 0)
+    {
+        const float LIMIT = 1e5f;
+        uint32_t limitBits;
+        std::memcpy(&limitBits, &LIMIT, sizeof(limitBits));
+        const double twoOverPi = 0.63661977236758134308;
+        const double halfPi = 1.57079632679489661923;
+        const double round = 6755399441055744.0;   // 1.5 * 2^52
+        uint32_t wide = 0;
+        for (size_t i = 0; i < n; ++i) {
+            // вне [-LIMIT;LIMIT] (и NaN) - ноль, потом заменится; сравнение
+            // и выбор над битами, без ветвлений, иначе цикл не векторизуется
+            uint32_t bits;
+            std::memcpy(&bits, &xs[i], sizeof(bits));
+            uint32_t outside = (bits & 0x7FFFFFFFu) > limitBits;
+            wide |= outside;
+            bits &= outside - 1;
+            float clamped;
+            std::memcpy(&clamped, &bits, sizeof(clamped));
+            double x = clamped;
+            double k = (x * twoOverPi + round) - round;
+            double t = x - k * halfPi;
+            double t2 = t * t;
+            double sn = t * (1 + t2 * (-1.0 / 6 + t2 * (1.0 / 120
+                + t2 * (-1.0 / 5040 + t2 * (1.0 / 362880)))));
+            double cs = 1 + t2 * (-0.5 + t2 * (1.0 / 24 + t2 * (-1.0 / 720
+                + t2 * (1.0 / 40320 + t2 * (-1.0 / 3628800)))));
+            // четверть: нечётная - косинус, 2 и 3 - со сменой знака
+            int q = (int(k) + shift) & 3;
+            double v = sn + (q & 1) * (cs - sn);
+            ys[i] = float((1 - (q & 2)) * v);
+        }
+        if (!wide)
+            return;
+        for (size_t i = 0; i < n; ++i) {
+            if (!(std::fabs(xs[i]) <= LIMIT))
+                ys[i] = shift ? std::cos(xs[i]) : std::sin(xs[i]);
+        }
+    }
+    static void cos(const float* xs, float* ys, size_t n)
+    {
+        sin(xs, ys, n, 1);
+    }
+};
+
+/**
+ * Операции выражений над числами типа T.
+ */
+template <typename T> struct ExprOps
+{
+    static T div(const T& a, const T& b) { return a / b; }
+    static T pow(const T& a, const T& b) { return std::pow(a, b); }
+    static T sqr(const T& a) { return a * a; }
+    static T sin(const T& a) { return std::sin(a); }
+    static T cos(const T& a) { return std::cos(a); }
+    static void sincos(const T& a, T& s, T& c) { s = std::sin(a); c = std::cos(a); }
+    static T tan(const T& a) { return std::tan(a); }
+    static T exp(const T& a) { return std::exp(a); }
+    static T log(const T& a) { return std::log(a); }
+    static T sqrt(const T& a) { return std::sqrt(a); }
+    static T abs(const T& a) { return std::fabs(a); }
+};
+
+// дружественные функции Interval видны только через ADL,
+// а внутри ExprOps<Interval> их скрывают одноимённые члены
+inline Interval intervalSqr(const Interval& a) { return sqr(a); }
+inline Interval intervalSin(const Interval& a) { return sin(a); }
+
+/**
+ * Операции выражений над интервалами: результат всегда содержит все
+ * значения; там, где оценка сложна, - вся числовая прямая.
+ */
+template <> struct ExprOps<Interval>
+{
+    typedef Interval I;
+
+    static I whole()
+    {
+        return I(-HUGE_VAL, HUGE_VAL);
+    }
+    static I div(const I& a, const I& b)
+    {
+        if (b.contains(0.0)) return whole();
+        return a * I(I::down(1 / b.hi), I::up(1 / b.lo));
+    }
+    static I pow(const I& a, const I& b)
+    {
+        if ((b.lo == b.hi) && (b.lo == std::floor(b.lo)) && (fabs(b.lo) <= 64)) {
+            int n = int(b.lo);
+            return n >= 0 ? ipow(a, n) : div(I(1.0), ipow(a, -n));
+        }
+        if (a.lo > 0) return exp(b * log(a));
+        return whole();
+    }
+    static I ipow(const I& a, int n)
+    {
+        if (n == 0) return I(1.0);
+        if (n % 2 == 0) return sqr(ipow(a, n / 2));
+        return a * ipow(a, n - 1);
+    }
+    static I sqr(const I& a) { return intervalSqr(a); }
+    static I sin(const I& a) { return intervalSin(a); }
+    static I cos(const I& a)
+    {
+        const double half = 3.14159265358979323846 / 2;
+        return intervalSin(a + I(I::down(half), I::up(half)));
+    }
+    static void sincos(const I& a, I& s, I& c)
+    {
+        s = sin(a);
+        c = cos(a);
+    }
+    static I tan(const I& a)
+    {
+        const double pi = 3.14159265358979323846;
+        // tan возрастает между полюсами pi/2 + k*pi
+        double k = std::ceil((a.lo - pi / 2) / pi - 1e-12);
+        if (!(pi / 2 + k * pi > a.hi + 1e-12)) return whole();
+        return I(I::down(I::down(std::tan(a.lo))), I::up(I::up(std::tan(a.hi))));
+    }
+    static I exp(const I& a)
+    {
+        return I(I::down(I::down(std::exp(a.lo))), I::up(I::up(std::exp(a.hi))));
+    }
+    static I log(const I& a)
+    {
+        double lo = a.lo > 0 ? I::down(I::down(std::log(a.lo))) : -HUGE_VAL;
+        double hi = a.hi > 0 ? I::up(I::up(std::log(a.hi))) : -HUGE_VAL;
+        return I(lo, hi);
+    }
+    static I sqrt(const I& a)
+    {
+        double lo = a.lo > 0 ? I::down(std::sqrt(a.lo)) : 0.0;
+        double hi = a.hi > 0 ? I::up(std::sqrt(a.hi)) : 0.0;
+        return I(lo, hi);
+    }
+    static I abs(const I& a)
+    {
+        if (a.contains(0.0)) return I(0.0, std::max(-a.lo, a.hi));
+        return a.lo > 0 ? a : -a;
+    }
+};
+
+/**
+ * Выражение, скомпилированное для вычисления: команды в порядке
+ * выполнения, результат команды i - в ячейке i (каждая ячейка
+ * записывается один раз), операнды - номера более ранних ячеек.
+ * Одинаковые подвыражения вычисляются один раз, константные -
+ * при компиляции, sin и cos одного аргумента - одним вызовом.
+ * Выходов может быть несколько (например, f, f' и f''). Команды
+ * могут храниться в арене, промежуточные данные компиляции тогда
+ * берутся из временной арены потока.
+ */
+class Program
+{
+public:
+    struct Instr
+    {
+        Expression::Op  op;     // операция
+        int             a, b;   // ячейки операндов
+        double          value;  // значение константы
+    };
+
+private:
+    static const size_t LOCAL = 64; // ячеек на стеке при вычислении
+    static const size_t BLOCK = 16; // точек в блоке при пакетном вычислении
+
+    typedef std::vector<Instr, ArenaAllocator<Instr>> Code;
+    typedef std::vector<int, ArenaAllocator<int>> Indices;
+
+    Code                code;   // команды
+    Indices             outputs;// ячейки результатов
+    bool                param;  // используется параметр p
+
+    /**
+     * Двоичное представление константы: по нему, а не по ==, ищутся
+     * одинаковые команды (NaN не равен себе, а -0.0 равен 0.0).
+     */
+    static uint64_t bits(double v)
+    {
+        uint64_t u;
+        std::memcpy(&u, &v, sizeof(u));
+        return u;
+    }
+
+    /**
+     * Выполнение программы с ячейками slots.
+     */
+    template <typename T> T run(const T& x, const T& p, T* slots) const
+    {
+        typedef ExprOps<T> M;
+        for (size_t i = 0; i < code.size(); ++i) {
+            const Instr& c = code[i];
+            switch (c.op) {
+            case Expression::OP_CONST: slots[i] = T(c.value); break;
+            case Expression::OP_X:     slots[i] = x; break;
+            case Expression::OP_P:     slots[i] = p; break;
+            case Expression::OP_ADD:   slots[i] = slots[c.a] + slots[c.b]; break;
+            case Expression::OP_SUB:   slots[i] = slots[c.a] - slots[c.b]; break;
+            case Expression::OP_MUL:   slots[i] = slots[c.a] * slots[c.b]; break;
+            case Expression::OP_DIV:   slots[i] = M::div(slots[c.a], slots[c.b]); break;
+            case Expression::OP_POW:   slots[i] = M::pow(slots[c.a], slots[c.b]); break;
+            case Expression::OP_NEG:   slots[i] = -slots[c.a]; break;
+            case Expression::OP_SQR:   slots[i] = M::sqr(slots[c.a]); break;
+            case Expression::OP_SIN:   slots[i] = M::sin(slots[c.a]); break;
+            case Expression::OP_COS:   slots[i] = M::cos(slots[c.a]); break;
+            case Expression::OP_TAN:   slots[i] = M::tan(slots[c.a]); break;
+            case Expression::OP_EXP:   slots[i] = M::exp(slots[c.a]); break;
+            case Expression::OP_LOG:   slots[i] = M::log(slots[c.a]); break;
+            case Expression::OP_SQRT:  slots[i] = M::sqrt(slots[c.a]); break;
+            case Expression::OP_ABS:   slots[i] = M::abs(slots[c.a]); break;
+            case Expression::OP_SINCOS:
+                M::sincos(slots[c.a], slots[i], slots[c.b]);
+                break;
+            case Expression::OP_COSSIN:
+                M::sincos(slots[c.a], slots[c.b], slots[i]);
+                break;
+            case Expression::OP_DONE:  break;
+            }
+        }
+        return slots[code.size() - 1];
+    }
+
+    /**
+     * sin и cos блока точек: в float - векторизуемыми ядрами LaneMath,
+     * в остальных типах - поточечно.
+     */
+    template <typename T> static void blockSin(const T* a, T* y, size_t m)
+    {
+        for (size_t j = 0; j < m; ++j) y[j] = ExprOps<T>::sin(a[j]);
+    }
+    template <typename T> static void blockCos(const T* a, T* y, size_t m)
+    {
+        for (size_t j = 0; j < m; ++j) y[j] = ExprOps<T>::cos(a[j]);
+    }
+    static void blockSin(const float* a, float* y, size_t m) { LaneMath::sin(a, y, m); }
+    static void blockCos(const float* a, float* y, size_t m) { LaneMath::cos(a, y, m); }
+    /**
+     * Выполнение программы сразу для m <= BLOCK точек xs: каждая команда
+     * разбирается один раз на блок, а цикл по точкам внутри неё
+     * компилятор может векторизовать. slots - code.size() строк по
+     * BLOCK ячеек.
+     */
+    template <typename T> void runBlock(const T* xs, const T& p, T* ys, size_t m,
+        T (*slots)[BLOCK]) const
+    {
+        typedef ExprOps<T> M;
+        for (size_t i = 0; i < code.size(); ++i) {
+            const Instr& c = code[i];
+            T* y = slots[i];
+            const T* a = c.a >= 0 ? slots[c.a] : nullptr;
+            const T* b = c.b >= 0 ? slots[c.b] : nullptr;
+            switch (c.op) {
+            case Expression::OP_CONST:
+                for (size_t j = 0; j < m; ++j) y[j] = T(c.value);
+                break;
+            case Expression::OP_X:
+                for (size_t j = 0; j < m; ++j) y[j] = xs[j];
+                break;
+            case Expression::OP_P:
+                for (size_t j = 0; j < m; ++j) y[j] = p;
+                break;
+            case Expression::OP_ADD:
+                for (size_t j = 0; j < m; ++j) y[j] = a[j] + b[j];
+                break;
+            case Expression::OP_SUB:
+                for (size_t j = 0; j < m; ++j) y[j] = a[j] - b[j];
+                break;
+            case Expression::OP_MUL:
+                for (size_t j = 0; j < m; ++j) y[j] = a[j] * b[j];
+                break;
+            case Expression::OP_DIV:
+                for (size_t j = 0; j < m; ++j) y[j] = M::div(a[j], b[j]);
+                break;
+            case Expression::OP_POW:
+                for (size_t j = 0; j < m; ++j) y[j] = M::pow(a[j], b[j]);
+                break;
+            case Expression::OP_NEG:
+                for (size_t j = 0; j < m; ++j) y[j] = -a[j];
+                break;
+            case Expression::OP_SQR:
+                for (size_t j = 0; j < m; ++j) y[j] = a[j] * a[j];
+                break;
+            case Expression::OP_SIN:   blockSin(a, y, m); break;
+            case Expression::OP_COS:   blockCos(a, y, m); break;
+            case Expression::OP_SINCOS:
+                blockSin(a, y, m);
+                blockCos(a, slots[c.b], m);
+                break;
+            case Expression::OP_COSSIN:
+                blockCos(a, y, m);
+                blockSin(a, slots[c.b], m);
+                break;
+            case Expression::OP_TAN:
+                for (size_t j = 0; j < m; ++j) y[j] = M::tan(a[j]);
+                break;
+            case Expression::OP_EXP:
+                for (size_t j = 0; j < m; ++j) y[j] = M::exp(a[j]);
+                break;
+            case Expression::OP_LOG:
+                for (size_t j = 0; j < m; ++j) y[j] = M::log(a[j]);
+                break;
+            case Expression::OP_SQRT:
+                for (size_t j = 0; j < m; ++j) y[j] = M::sqrt(a[j]);
+                break;
+            case Expression::OP_ABS:
+                for (size_t j = 0; j < m; ++j) y[j] = M::abs(a[j]);
+                break;
+            case Expression::OP_DONE:  break;
+            }
+        }
+        const T* result = slots[code.size() - 1];
+        for (size_t j = 0; j < m; ++j) ys[j] = result[j];
+    }
+
+public:
+
+    /**
+     * Операция op над значениями a и b (у одноместных b не важен) -
+     * для свёртки констант; в run() тот же разбор
+     * операций встроен в цикл, так он заметно быстрее.
+     */
+    template <typename T> static T apply(Expression::Op op, const T& a, const T& b)
+    {
+        typedef ExprOps<T> M;
+        switch (op) {
+        case Expression::OP_ADD:   return a + b;
+        case Expression::OP_SUB:   return a - b;
+        case Expression::OP_MUL:   return a * b;
+        case Expression::OP_DIV:   return M::div(a, b);
+        case Expression::OP_POW:   return M::pow(a, b);
+        case Expression::OP_NEG:   return -a;
+        case Expression::OP_SQR:   return M::sqr(a);
+        case Expression::OP_SIN:   return M::sin(a);
+        case Expression::OP_COS:   return M::cos(a);
+        case Expression::OP_TAN:   return M::tan(a);
+        case Expression::OP_EXP:   return M::exp(a);
+        case Expression::OP_LOG:   return M::log(a);
+        case Expression::OP_SQRT:  return M::sqrt(a);
+        case Expression::OP_ABS:   return M::abs(a);
+        default:                   return a;
+        }
+    }
+
+    Program() : code(), outputs(), param(false) {}
+    /**
+     * Компиляция выражения (выход - корень дерева).
+     */
+    explicit Program(const Expression& e, Arena* arena = nullptr) :
+        Program(e, nullptr, 0, arena)
+    {
+    }
+    /**
+     * Компиляция выражения с выходами в count узлах roots (при count
+     * == 0 - корень дерева); команды - в арене arena, если она задана.
+     */
+    Program(const Expression& e, const int* roots, size_t count,
+        Arena* arena = nullptr) :
+        code(ArenaAllocator<Instr>(arena)), outputs(ArenaAllocator<int>(arena)),
+        param(false)
+    {
+        typedef std::tuple<int, int, int, uint64_t> Key;
+        typedef std::map<Key, int, std::less<Key>,
+            ArenaAllocator<std::pair<const Key, int>>> Known;
+        Arena* tmp = arena ? &Arena::scratch() : nullptr;
+        Arena::Scope scope(tmp);
+        const Expression::Nodes& nodes = e.getNodes();
+        int last = nodes.size() - 1;
+        if (count == 0) {
+            roots = &last;
+            count = 1;
+        }
+        Indices slot(nodes.size(), 0, ArenaAllocator<int>(tmp));
+        Known known{ std::less<Key>(), ArenaAllocator<std::pair<const Key, int>>(tmp) };
+        code.reserve(nodes.size() + 1);
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            Instr c = { nodes[i].op, -1, -1, nodes[i].value };
+            int n = Expression::arity(c.op);
+            if (n > 0) c.a = slot[nodes[i].a];
+            if (n > 1) c.b = slot[nodes[i].b];
+            // x^2 - отдельная команда (для интервалов она точнее)
+            if ((c.op == Expression::OP_POW)
+                && (code[c.b].op == Expression::OP_CONST)
+                && (code[c.b].value == 2.0)) {
+                c.op = Expression::OP_SQR;
+                c.b = -1;
+                n = 1;
+            }
+            bool constant = n > 0;
+            if (n > 0) constant = code[c.a].op == Expression::OP_CONST;
+            if (n > 1) constant = constant && (code[c.b].op == Expression::OP_CONST);
+            if (constant) {
+                c.value = apply(c.op, code[c.a].value,
+                    n > 1 ? code[c.b].value : 0.0);
+                c.op = Expression::OP_CONST;
+                c.a = c.b = -1;
+            }
+            if (c.op == Expression::OP_P) param = true;
+            auto key = std::make_tuple(int(c.op), c.a, c.b, bits(c.value));
+            auto it = known.find(key);
+            if (it != known.end()) {
+                slot[i] = it->second;
+                continue;
+            }
+            code.push_back(c);
+            slot[i] = known[key] = code.size() - 1;
+        }
+        // удаление команд, результат которых не нужен (операнды
+        // свёрнутых констант); корень - наибольшая из нужных ячеек,
+        // поэтому после сжатия он окажется последним
+        int root = 0;
+        for (size_t k = 0; k < count; ++k)
+            root = std::max(root, slot[roots[k]]);
+        std::vector<char, ArenaAllocator<char>> live(root + 1, 0,
+            ArenaAllocator<char>(tmp));
+        for (size_t k = 0; k < count; ++k)
+            live[slot[roots[k]]] = 1;
+        for (int i = root; i >= 0; --i) {
+            if (!live[i]) continue;
+            if (code[i].a >= 0) live[code[i].a] = 1;
+            if (code[i].b >= 0) live[code[i].b] = 1;
+        }
+        Indices index(root + 1, -1, ArenaAllocator<int>(tmp));
+        Code kept{ ArenaAllocator<Instr>(tmp) };
+        kept.reserve(root + 1);
+        for (int i = 0; i <= root; ++i) {
+            if (!live[i]) continue;
+            Instr c = code[i];
+            if (c.a >= 0) c.a = index[c.a];
+            if (c.b >= 0) c.b = index[c.b];
+            index[i] = kept.size();
+            kept.push_back(c);
+        }
+        code.assign(kept.begin(), kept.end());
+        outputs.reserve(count);
+        for (size_t k = 0; k < count; ++k)
+            outputs.push_back(index[slot[roots[k]]]);
+        // sin и cos одного аргумента: первая из команд считает обе
+        // (sincos), вторая ничего не делает
+        for (size_t i = 0; i < code.size(); ++i) {
+            Expression::Op op = code[i].op;
+            if ((op != Expression::OP_SIN) && (op != Expression::OP_COS))
+                continue;
+            Expression::Op other = op == Expression::OP_SIN
+                ? Expression::OP_COS : Expression::OP_SIN;
+            for (size_t j = i + 1; j < code.size(); ++j) {
+                if ((code[j].op != other) || (code[j].a != code[i].a))
+                    continue;
+                code[i].op = op == Expression::OP_SIN
+                    ? Expression::OP_SINCOS : Expression::OP_COSSIN;
+                code[i].b = j;
+                code[j].op = Expression::OP_DONE;
+                break;
+            }
+        }
+    }
+    /**
+     * Программа, вычисляющая вместе f, f' и f'' выражения e (выходы 0,
+     * 1 и 2) с общими промежуточными значениями; команды - в арене
+     * arena, если она задана.
+     */
+    static Program derivatives(const Expression& e, Arena* arena = nullptr)
+    {
+        Arena* tmp = arena ? &Arena::scratch() : nullptr;
+        Arena::Scope scope(tmp);
+        int roots[3];
+        Expression d = Expression::differentiate(e, roots, tmp);
+        return Program(d, roots, 3, arena);
+    }
+    /**
+     * Значение в точке x при параметре p.
+     */
+    template <typename T> T eval(const T& x, const T& p) const
+    {
+        if (code.size() <= LOCAL) {
+            T slots[LOCAL];
+            return run(x, p, slots);
+        }
+        std::vector<T> slots(code.size());
+        return run(x, p, slots.data());
+    }
+    /**
+     * Значения в n точках xs при параметре p (блоками по BLOCK точек,
+     * см. runBlock).
+     */
+    template <typename T> void evalMany(const T* xs, T* ys, size_t n,
+        const T& p) const
+    {
+        T local[LOCAL][BLOCK];
+        std::vector<T> heap(code.size() > LOCAL ? code.size() * BLOCK : 0);
+        T (*slots)[BLOCK] = heap.empty() ? local
+            : reinterpret_cast<T (*)[BLOCK]>(heap.data());
+        for (size_t i = 0; i < n; i += BLOCK)
+            runBlock(xs + i, p, ys + i, std::min(BLOCK, n - i), slots);
+    }
+    /**
+     * Значения всех выходов в точке x при параметре p, результат в out.
+     */
+    template <typename T> void evalAll(const T& x, const T& p, T* out) const
+    {
+        T local[LOCAL];
+        std::vector<T> heap(code.size() > LOCAL ? code.size() : 0);
+        T* slots = heap.empty() ? local : heap.data();
+        run(x, p, slots);
+        for (size_t k = 0; k < outputs.size(); ++k)
+            out[k] = slots[outputs[k]];
+    }
+    size_t getSize() const { return code.size(); }
+    bool usesParam() const { return param; }
+};
+
+/**
+ * Скомпилированное выражение: программа значения и программа f, f'
+ * и f'' в общей арене. Один объект разделяют все функции с тем же
+ * выражением; арена освобождается вместе с последней из них.
+ */
+struct CompiledExpression
+{
+    Arena   arena;
+    Program program;    // значение
+    Program derivs;     // f, f' и f''
+
+    explicit CompiledExpression(const Expression& e) :
+        arena(2048), program(e, &arena), derivs(Program::derivatives(e, &arena))
+    {
+    }
+};
+
+/**
+ * Кэш скомпилированных выражений: каждое выражение компилируется один
+ * раз за время работы, сколько бы раз оно ни встречалось. Ключ -
+ * каноническая запись выражения, по её хэшу выбирается одна из частей
+ * кэша со своей блокировкой; в каждой части вытесняется давно не
+ * использованное выражение (LRU).
+ */
+class CompileCache
+{
+    static const size_t SHARDS = 16;
+
+    typedef std::shared_ptr<const CompiledExpression> Compiled;
+    typedef std::list<std::pair<std::string, Compiled>> Order;
+    typedef std::basic_string<char, std::char_traits<char>, ArenaAllocator<char>> Text;
+
+    struct Shard
+    {
+        std::mutex  lock;
+        Order       order;  // в начале - использованные последними
+        std::unordered_map<std::string, Order::iterator> index;
+    };
+
+    Shard                   shards[SHARDS];
+    size_t                  capacity;   // выражений в части
+    std::atomic<uint64_t>   hits, misses, bypasses;
+
+public:
+
+    explicit CompileCache(size_t perShard) :
+        capacity(perShard), hits(0), misses(0), bypasses(0)
+    {
+    }
+    /**
+     * Общий кэш программы.
+     */
+    static CompileCache& instance()
+    {
+        static CompileCache cache(256);
+        return cache;
+    }
+    /**
+     * Каноническая запись выражения e: без пробелов, с вычисленными
+     * константными подвыражениями (константы - точно, в 16-ричной
+     * записи), операнды + и * - в порядке возрастания их записей.
+     * Операции не перегруппировываются: это изменило бы округление.
+     * Пустая строка - запись длиннее limit символов (у выражений с
+     * многократно подставленными функциями она растёт экспоненциально).
+     */
+    static std::string canonical(const Expression& e, size_t limit = 4096)
+    {
+        static const char* const NAMES[] = {
+            "", "x", "p", "+", "-", "*", "/", "^",
+            "-", "sqr", "sin", "cos", "tan", "exp", "log", "sqrt", "abs"
+        };
+        Arena* tmp = &Arena::scratch();
+        Arena::Scope scope(tmp);
+        const Expression::Nodes& nodes = e.getNodes();
+        std::vector<Text, ArenaAllocator<Text>> text(ArenaAllocator<Text>{ tmp });
+        std::vector<double, ArenaAllocator<double>> value(nodes.size(), 0.0,
+            ArenaAllocator<double>(tmp));
+        std::vector<char, ArenaAllocator<char>> constant(nodes.size(), 0,
+            ArenaAllocator<char>(tmp));
+        text.reserve(nodes.size());
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            const Expression::Node& n = nodes[i];
+            int arity = Expression::arity(n.op);
+            text.emplace_back(ArenaAllocator<char>(tmp));
+            Text& t = text.back();
+            if (n.op == Expression::OP_CONST) {
+                constant[i] = 1;
+                value[i] = n.value;
+            }
+            else if ((arity > 0) && constant[n.a] && ((arity == 1) || constant[n.b])) {
+                constant[i] = 1;
+                value[i] = Program::apply(n.op, value[n.a], arity > 1 ? value[n.b] : 0.0);
+            }
+            if (constant[i]) {
+                char buf[32];
+                snprintf(buf, sizeof(buf), "%a", value[i]);
+                t = buf;
+                continue;
+            }
+            if (arity == 0) {
+                t = NAMES[n.op];
+            }
+            else if (arity == 2) {
+                const Text* a = &text[n.a];
+                const Text* b = &text[n.b];
+                if (((n.op == Expression::OP_ADD) || (n.op == Expression::OP_MUL))
+                    && (*b < *a))
+                    std::swap(a, b);
+                t.reserve(a->size() + b->size() + 3);
+                t += '(';
+                t += *a;
+                t += NAMES[n.op];
+                t += *b;
+                t += ')';
+            }
+            else {
+                t.reserve(text[n.a].size() + 6);
+                t += NAMES[n.op];
+                t += '(';
+                t += text[n.a];
+                t += ')';
+            }
+            if (t.size() > limit)
+                return std::string();
+        }
+        return std::string(text.back().begin(), text.back().end());
+    }
+    /**
+     * Скомпилированное выражение e: из кэша или новое.
+     */
+    Compiled get(const Expression& e)
+    {
+        std::string key = canonical(e);
+        if (key.empty()) {
+            ++bypasses;
+            return std::make_shared<const CompiledExpression>(e);
+        }
+        Shard& shard = shards[std::hash<std::string>()(key) % SHARDS];
+        {
+            std::lock_guard<std::mutex> guard(shard.lock);
+            auto it = shard.index.find(key);
+            if (it != shard.index.end()) {
+                shard.order.splice(shard.order.begin(), shard.order, it->second);
+                ++hits;
+                return it->second->second;
+            }
+        }
+        // компиляция без блокировки; если то же выражение за это время
+        // скомпилировал другой поток, используется его результат
+        ++misses;
+        Compiled compiled = std::make_shared<const CompiledExpression>(e);
+        std::lock_guard<std::mutex> guard(shard.lock);
+        auto it = shard.index.find(key);
+        if (it != shard.index.end())
+            return it->second->second;
+        shard.order.emplace_front(key, compiled);
+        shard.index.emplace(std::move(key), shard.order.begin());
+        if (shard.order.size() > capacity) {
+            shard.index.erase(shard.order.back().first);
+            shard.order.pop_back();
+        }
+        return compiled;
+    }
+    uint64_t getHits() const { return hits.load(); }
+    uint64_t getMisses() const { return misses.load(); }
+    /**
+     * Статистика для вывода (пустая, если кэш не использовался).
+     */
+    std::string getMetricsString() const
+    {
+        uint64_t h = hits.load(), m = misses.load(), b = bypasses.load();
+        if (h + m + b == 0)
+            return std::string();
+        std::ostringstream oss;
+        oss << "Кэш компиляции: попаданий " << h << " из " << h + m + b
+            << " (" << 100.0 * h / (h + m + b) << "%)";
+        if (b)
+            oss << ", слишком длинных выражений: " << b;
+        return oss.str();
+    }
+};
+
+/**
+ * Функция.
+ */
+class Function
+{
+    std::string     name;
+    uint64_t        version;    // уникален для каждого объекта функции
+
+    static uint64_t nextVersion()
+    {
+        static std::atomic<uint64_t> counter(0);
+        return ++counter;
+    }
+
+protected:
+
+    Function(const char* text) :
+        name(std::string("y = ") + std::string(text)), version(nextVersion())
+    {
+    }
+
+    /**
+     * Собственно значение функции, переопределить в наследниках.
+     */
+    virtual double f(double x) const = 0;
+    /**
+     * Интервальное расширение функции: интервал, гарантированно
+     * содержащий все значения на x. Переопределить в наследниках,
+     * поддерживающих интервальную арифметику.
+     */
+    virtual Interval fi(const Interval&) const
+    {
+        throw MyError("Функция не поддерживает интервальную арифметику");
+    }
+    /**
+     * Значения функции сразу в n точках. Переопределить в наследниках,
+     * если пакетное вычисление дешевле поточечного.
+     */
+    virtual void fv(const double* xs, double* ys, size_t n) const
+    {
+        for (size_t i = 0; i < n; ++i)
+            ys[i] = f(xs[i]);
+    }
+    /**
+     * Значения в float сразу в n точках (для грубых этапов поиска).
+     * Переопределить в наследниках, у которых есть быстрый вариант.
+     */
+    virtual void fvf(const float* xs, float* ys, size_t n) const
+    {
+        for (size_t i = 0; i < n; ++i)
+            ys[i] = float(f(xs[i]));
+    }
+    /**
+     * Значение в двойной-двойной точности. По умолчанию считается в
+     * double, переопределить в наследниках, умеющих считать точнее.
+     */
+    virtual DoubleDouble fdd(const DoubleDouble& x) const
+    {
+        return DoubleDouble(f(x.hi));
+    }
+    /**
+     * Точные значения f, f' и f'' в точке x (в d[0], d[1], d[2]).
+     * Переопределить в наследниках, умеющих дифференцировать; по
+     * умолчанию производных нет и возвращается false.
+     */
+    virtual bool fd(double, double*) const
+    {
+        return false;
+    }
+#ifdef HAVE_FLOAT128
+    /**
+     * Значение в четверной точности. По умолчанию считается в double.
+     */
+    virtual Quad fq(Quad x) const
+    {
+        return Quad(f(double(x)));
+    }
+#endif
+
+public:
+
+    virtual ~Function() {}
+
+    /**
+     * Значение функции в точке x.
+     */
+    double calcValue(double x) const
+    {
+        return f(x);
+    }
+    /**
+     * Значения функции в float в n точках xs, результат в ys.
+     */
+    void calcValues(const float* xs, float* ys, size_t n) const
+    {
+        fvf(xs, ys, n);
+    }
+    /**
+     * Значение функции в точке x повышенной точности.
+     */
+    DoubleDouble calcValue(const DoubleDouble& x) const
+    {
+        return fdd(x);
+    }
+#ifdef HAVE_FLOAT128
+    Quad calcValue(Quad x) const
+    {
+        return fq(x);
+    }
+#endif
+    /**
+     * Значения функции в n точках xs, результат в ys.
+     */
+    void calcValues(const double* xs, double* ys, size_t n) const
+    {
+        fv(xs, ys, n);
+    }
+    /**
+     * Оценка множества значений функции на отрезке x.
+     */
+    Interval calcRange(const Interval& x) const
+    {
+        return fi(x);
+    }
+    /**
+     * Значение и точные производные в точке x: d[0] = f, d[1] = f',
+     * d[2] = f''. Возвращает false, если функция их не считает.
+     */
+    bool calcDerivatives(double x, double d[3]) const
+    {
+        return fd(x, d);
+    }
+    /**
+     * Значение производной в точке x: точное, если функция умеет его
+     * считать, иначе разностное с точностью eps.
+     */
+    double calcDerivation(double x, double eps) const
+    {
+        double d[3];
+        if (fd(x, d))
+            return d[1];
+        double dx = eps / 10.0;
+        return (f(x + dx) - f(x)) / dx;
+    }
+    /**
+     * Имя функции.
+     */
+    const std::string& getName() const
+    {
+        return name;
+    }
+    /**
+     * Дерево выражения функции, если оно есть (для объединения
+     * функций в одну программу), иначе nullptr.
+     */
+    virtual const Expression* getExpression() const
+    {
+        return nullptr;
+    }
+    /**
+     * Считает ли функция значения точнее double (переопределены fdd и
+     * fq). Иначе и в повышенной точности значения - из double.
+     */
+    virtual bool hasExtendedPrecision() const
+    {
+        return false;
+    }
+    /**
+     * Версия: разные объекты функций (в том числе новое определение
+     * на месте удалённого) всегда имеют разные версии, в отличие от
+     * адресов.
+     */
+    uint64_t getVersion() const
+    {
+        return version;
+    }
+};
+
+/**
+ * Функция y = x^2
+ */
+class Square : public Function
+{
+public:
+    Square() : Function("x^2") {}
+    virtual const Expression* getExpression() const
+    {
+        static const Expression expr("x^2");
+        return &expr;
+    }
+    virtual bool hasExtendedPrecision() const
+    {
+        return true;
+    }
+protected:
+    virtual double f(double x) const
+    {
+        return x * x;
+    }
+    virtual Interval fi(const Interval& x) const
+    {
+        return sqr(x);
+    }
+    virtual void fv(const double* xs, double* ys, size_t n) const
+    {
+        for (size_t i = 0; i < n; ++i)
+            ys[i] = xs[i] * xs[i];
+    }
+    virtual void fvf(const float* xs, float* ys, size_t n) const
+    {
+        for (size_t i = 0; i < n; ++i)
+            ys[i] = xs[i] * xs[i];
+    }
+    virtual DoubleDouble fdd(const DoubleDouble& x) const
+    {
+        return x * x;
+    }
+    virtual bool fd(double x, double* d) const
+    {
+        d[0] = x * x;
+        d[1] = 2 * x;
+        d[2] = 2;
+        return true;
+    }
+#ifdef HAVE_FLOAT128
+    virtual Quad fq(Quad x) const
+    {
+        return x * x;
+    }
+#endif
+};
+
+/**
+ * Функция y = sin(x)
+ */
+class Sin : public Function
+{
+public:
+    Sin() : Function("sin(x)") {}
+    virtual const Expression* getExpression() const
+    {
+        static const Expression expr("sin(x)");
+        return &expr;
+    }
+    virtual bool hasExtendedPrecision() const
+    {
+        return true;
+    }
+protected:
+    virtual double f(double x) const
+    {
+        return sin(x);
+    }
+    virtual Interval fi(const Interval& x) const
+    {
+        return sin(x);
+    }
+    virtual void fv(const double* xs, double* ys, size_t n) const
+    {
+        for (size_t i = 0; i < n; ++i)
+            ys[i] = std::sin(xs[i]);
+    }
+    virtual void fvf(const float* xs, float* ys, size_t n) const
+    {
+        LaneMath::sin(xs, ys, n);
+    }
+    virtual DoubleDouble fdd(const DoubleDouble& x) const
+    {
+        return sinT(x);
+    }
+    virtual bool fd(double x, double* d) const
+    {
+        d[0] = std::sin(x);
+        d[1] = std::cos(x);
+        d[2] = -d[0];
+        return true;
+    }
+#ifdef HAVE_FLOAT128
+    virtual Quad fq(Quad x) const
+    {
+        return sinT(x);
+    }
+#endif
+};
+
+/**
+ * Семейство функций y = f(x; p), зависящих от параметра p.
+ */
+class ParametricFunction
+{
+    std::string     name;
+
+protected:
+
+    ParametricFunction(const char* text) :
+        name(std::string("y = ") + std::string(text))
+    {
+    }
+
+    /**
+     * Собственно значение функции, переопределить в наследниках.
+     */
+    virtual double f(double x, double p) const = 0;
+    /**
+     * Значения сразу в n точках xs при параметрах ps. Переопределить в
+     * наследниках, если пакетное вычисление дешевле поточечного.
+     */
+    virtual void fv(const double* xs, const double* ps, double* ys, size_t n) const
+    {
+        for (size_t i = 0; i < n; ++i)
+            ys[i] = f(xs[i], ps[i]);
+    }
+
+public:
+
+    virtual ~ParametricFunction() {}
+
+    /**
+     * Значение функции в точке x при параметре p.
+     */
+    double calcValue(double x, double p) const
+    {
+        return f(x, p);
+    }
+    /**
+     * Значения в n точках xs при своём для каждой точки параметре ps,
+     * результат в ys.
+     */
+    void calcValues(const double* xs, const double* ps, double* ys, size_t n) const
+    {
+        fv(xs, ps, ys, n);
+    }
+    /**
+     * Имя семейства.
+     */
+    const std::string& getName() const
+    {
+        return name;
+    }
+};
+
+/**
+ * Семейство y = (x - p)^2
+ */
+class ShiftedSquare : public ParametricFunction
+{
+public:
+    ShiftedSquare() : ParametricFunction("(x - p)^2") {}
+protected:
+    virtual double f(double x, double p) const
+    {
+        return (x - p) * (x - p);
+    }
+    virtual void fv(const double* xs, const double* ps, double* ys, size_t n) const
+    {
+        for (size_t i = 0; i < n; ++i)
+            ys[i] = (xs[i] - ps[i]) * (xs[i] - ps[i]);
+    }
+};
+
+/**
+ * Семейство y = sin(x + p)
+ */
+class ShiftedSin : public ParametricFunction
+{
+public:
+    ShiftedSin() : ParametricFunction("sin(x + p)") {}
+protected:
+    virtual double f(double x, double p) const
+    {
+        return sin(x + p);
+    }
+};
+
+/**
+ * Функция семейства при фиксированном значении параметра.
+ */
+class BoundFunction : public Function
+{
+    const ParametricFunction&   family; // семейство
+    double                      param;  // значение параметра
+
+public:
+    BoundFunction(const ParametricFunction& fam, double p) :
+        Function((fam.getName().substr(4) + ", p = "
+            + std::to_string(p)).c_str()),
+        family(fam), param(p)
+    {
+    }
+protected:
+    virtual double f(double x) const
+    {
+        return family.calcValue(x, param);
+    }
+};
+
+/**
+ * Функция, значения которой вычисляет внешний процесс. Процесс
+ * запускается командой оболочки и общается через каналы (pipe):
+ * запрос - uint32 n и n значений x (double), ответ - n значений f(x).
+ * Одновременные запросы из разных потоков объединяются в одно
+ * сообщение, одинаковые x, уже ожидающие ответа, повторно не
+ * отправляются (x сравниваются по двоичному представлению, так что
+ * -0.0 и 0.0 - разные точки). Ожидающих ответа точек не больше
+ * maxInflight: новые запросы ждут, пока освободится место.
+ */
+class ExternalFunction : public Function
+{
+    using Slot = std::shared_future<double>;
+
+    static const uint32_t MAX_MESSAGE = 1 << 20;    // предел точек в сообщении
+
+    std::string                 command;    // команда запуска вычислителя
+    size_t                      maxBatch;   // предел точек в одном сообщении
+    size_t                      maxInflight;// предел точек, ожидающих ответа
+    mutable std::mutex          mtx;
+    mutable std::condition_variable room;   // ответ получен, место освободилось
+    mutable std::unordered_map<uint64_t, Slot> inflight;    // x -> ответ
+    mutable std::vector<std::pair<double, std::promise<double>>> queue;
+    mutable bool                sending;    // есть поток, ведущий обмен
+    mutable size_t              batches;    // отправлено сообщений
+    mutable size_t              points;     // отправлено точек
+    mutable size_t              merged;     // запросов, слитых с ожидающими
+#ifndef _WIN32
+    pid_t                       child;      // процесс-вычислитель
+    int                         toChild;    // канал запросов
+    int                         fromChild;  // канал ответов
+#endif
+
+public:
+
+    ExternalFunction(const std::string& cmd, size_t limit = 65536,
+        size_t batch = 4096) :
+        Function(("внешняя: " + cmd).c_str()),
+        command(cmd),
+        maxBatch(std::min<size_t>(MAX_MESSAGE, std::max<size_t>(1, batch))),
+        maxInflight(std::max<size_t>(1, limit)), mtx(), room(), inflight(),
+        queue(), sending(false), batches(0), points(0), merged(0)
+    {
+#ifdef _WIN32
+        throw MyError("Внешние вычислители поддерживаются только в POSIX");
+#else
+        int req[2], resp[2];
+        if (pipe(req) != 0)
+            throw MyError("Не удалось создать канал");
+        if (pipe(resp) != 0) {
+            close(req[0]);
+            close(req[1]);
+            throw MyError("Не удалось создать канал");
+        }
+        // другие вычислители не должны унаследовать наши концы каналов,
+        // иначе после закрытия канала запросов вычислитель не увидит
+        // его конца; у stdin и stdout ребёнка (dup2) флаг снимается
+        for (int fd : { req[0], req[1], resp[0], resp[1] })
+            fcntl(fd, F_SETFD, FD_CLOEXEC);
+        child = fork();
+        if (child < 0) {
+            close(req[0]); close(req[1]);
+            close(resp[0]); close(resp[1]);
+            throw MyError("Не удалось запустить вычислитель");
+        }
+        if (child == 0) {
+            dup2(req[0], 0);
+            dup2(resp[1], 1);
+            close(req[0]); close(req[1]);
+            close(resp[0]); close(resp[1]);
+            execl("/bin/sh", "sh", "-c", command.c_str(), (char*)nullptr);
+            _exit(127);
+        }
+        close(req[0]);
+        close(resp[1]);
+        toChild = req[1];
+        fromChild = resp[0];
+#endif
+    }
+    virtual ~ExternalFunction()
+    {
+#ifndef _WIN32
+        close(toChild);
+        close(fromChild);
+        waitpid(child, nullptr, 0);
+#endif
+    }
+    /**
+     * Статистика обмена: сообщений, точек, слитых запросов.
+     */
+    size_t getBatches() const { std::lock_guard<std::mutex> l(mtx); return batches; }
+    size_t getPoints() const { std::lock_guard<std::mutex> l(mtx); return points; }
+    size_t getMerged() const { std::lock_guard<std::mutex> l(mtx); return merged; }
+
+    /**
+     * Работа в роли вычислителя: чтение запросов из in, ответы в out,
+     * пока канал не закроют или не придёт сообщение больше
+     * MAX_MESSAGE точек. delay - имитация дорогой функции, мкс на
+     * точку.
+     */
+    static void serve(const Function& fun, int in, int out, int delay)
+    {
+#ifdef _WIN32
+        throw MyError("Внешние вычислители поддерживаются только в POSIX");
+#else
+        std::vector<double> xs, ys;
+        uint32_t n;
+        while (readAll(in, &n, sizeof(n))) {
+            // n пришло извне: без проверки - выделение по мусору
+            if (n > MAX_MESSAGE)
+                break;
+            xs.resize(n);
+            ys.resize(n);
+            if (!readAll(in, xs.data(), n * sizeof(double)))
+                break;
+            if (delay > 0)
+                std::this_thread::sleep_for(std::chrono::microseconds(delay));
+            fun.calcValues(xs.data(), ys.data(), n);
+            if (!writeAll(out, ys.data(), n * sizeof(double)))
+                break;
+        }
+#endif
+    }
+
+protected:
+
+    virtual double f(double x) const
+    {
+        double y;
+        fv(&x, &y, 1);
+        return y;
+    }
+    virtual void fv(const double* xs, double* ys, size_t n) const
+    {
+        std::vector<Slot> slots(n);
+        std::unique_lock<std::mutex> lock(mtx);
+        for (size_t i = 0; i < n; ++i) {
+            auto it = inflight.find(key(xs[i]));
+            if (it != inflight.end()) {
+                slots[i] = it->second;
+                ++merged;
+                continue;
+            }
+            while (inflight.size() >= maxInflight) {
+                // места нет: отправить накопленное самим или ждать ответа
+                if (!sending)
+                    flush(lock);
+                else
+                    room.wait(lock);
+            }
+            queue.push_back(std::make_pair(xs[i], std::promise<double>()));
+            slots[i] = queue.back().second.get_future().share();
+            inflight[key(xs[i])] = slots[i];
+        }
+        if (!sending)
+            flush(lock);
+        lock.unlock();
+        for (size_t i = 0; i < n; ++i)
+            ys[i] = slots[i].get();
+    }
+
+private:
+
+    /**
+     * Ключ точки в inflight - двоичное представление x.
+     */
+    static uint64_t key(double x)
+    {
+        uint64_t u;
+        std::memcpy(&u, &x, sizeof(u));
+        return u;
+    }
+    /**
+     * Отправка всего накопившегося, включая чужие запросы (вызывается
+     * под mtx, когда никто другой не отправляет).
+     */
+    void flush(std::unique_lock<std::mutex>& lock) const
+    {
+        sending = true;
+        while (!queue.empty()) {
+            std::vector<std::pair<double, std::promise<double>>> batch;
+            size_t count = std::min(queue.size(), maxBatch);
+            std::move(queue.begin(), queue.begin() + count,
+                std::back_inserter(batch));
+            queue.erase(queue.begin(), queue.begin() + count);
+            ++batches;
+            points += count;
+            lock.unlock();
+            exchange(batch);
+            lock.lock();
+            for (auto& item : batch)
+                inflight.erase(key(item.first));
+            room.notify_all();
+        }
+        sending = false;
+        room.notify_all();
+    }
+
+    /**
+     * Отправка пакета и получение ответа (вызывается одним потоком).
+     */
+    void exchange(std::vector<std::pair<double, std::promise<double>>>& batch) const
+    {
+#ifndef _WIN32
+        uint32_t n = batch.size();
+        std::vector<double> buf(n);
+        for (uint32_t i = 0; i < n; ++i) buf[i] = batch[i].first;
+        if (writeAll(toChild, &n, sizeof(n))
+            && writeAll(toChild, buf.data(), n * sizeof(double))
+            && readAll(fromChild, buf.data(), n * sizeof(double))) {
+            for (uint32_t i = 0; i < n; ++i) batch[i].second.set_value(buf[i]);
+            return;
+        }
+#endif
+        for (auto& item : batch) {
+            item.second.set_exception(std::make_exception_ptr(
+                MyError("Вычислитель не отвечает")));
+        }
+    }
+#ifndef _WIN32
+    /**
+     * Запись всех данных. Если читатель канала завершился, write
+     * возвращает EPIPE, а SIGPIPE, заблокированный на время записи в
+     * этом потоке, забирается sigwait и до процесса не доходит.
+     */
+    static bool writeAll(int fd, const void* data, size_t size)
+    {
+        sigset_t pipeSet, old, pending;
+        sigemptyset(&pipeSet);
+        sigaddset(&pipeSet, SIGPIPE);
+        pthread_sigmask(SIG_BLOCK, &pipeSet, &old);
+        sigpending(&pending);
+        bool wasPending = sigismember(&pending, SIGPIPE);
+        bool broken = false;
+        const char* p = static_cast<const char*>(data);
+        while (size > 0) {
+            ssize_t k = write(fd, p, size);
+            if ((k < 0) && (errno == EINTR))
+                continue;
+            if (k <= 0) {
+                broken = (k < 0) && (errno == EPIPE);
+                break;
+            }
+            p += k;
+            size -= k;
+        }
+        if (broken && !wasPending) {
+            int sig;
+            sigwait(&pipeSet, &sig);
+        }
+        pthread_sigmask(SIG_SETMASK, &old, nullptr);
+        return size == 0;
+    }
+    static bool readAll(int fd, void* data, size_t size)
+    {
+        char* p = static_cast<char*>(data);
+        while (size > 0) {
+            ssize_t k = read(fd, p, size);
+            if (k <= 0) return false;
+            p += k;
+            size -= k;
+        }
+        return true;
+    }
+#endif
+};
+
+/**
+ * Файл, отображённый в память только для чтения. Данные не копируются
+ * в кучу: страницы подгружает ОС по мере обращения.
+ */
+class MappedFile
+{
+    const char* data;   // начало отображения
+    size_t      size;   // размер файла
+#ifdef _WIN32
+    HANDLE      file;
+    HANDLE      mapping;
+#endif
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+public:
+
+    MappedFile(const std::string& path) : data(nullptr), size(0)
+    {
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ,
+            nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+            throw MyError("Не удалось открыть файл");
+        LARGE_INTEGER len;
+        GetFileSizeEx(file, &len);
+        size = size_t(len.QuadPart);
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!mapping) {
+            CloseHandle(file);
+            throw MyError("Не удалось отобразить файл в память");
+        }
+        data = static_cast<const char*>(
+            MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+        if (!data) {
+            CloseHandle(mapping);
+            CloseHandle(file);
+            throw MyError("Не удалось отобразить файл в память");
+        }
+#else
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw MyError("Не удалось открыть файл");
+        struct stat st;
+        if ((fstat(fd, &st) != 0) || (st.st_size == 0)) {
+            close(fd);
+            throw MyError("Не удалось открыть файл");
+        }
+        size = st.st_size;
+        void* p = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (p == MAP_FAILED)
+            throw MyError("Не удалось отобразить файл в память");
+        data = static_cast<const char*>(p);
+#endif
+    }
+    ~MappedFile()
+    {
+#ifdef _WIN32
+        UnmapViewOfFile(data);
+        CloseHandle(mapping);
+        CloseHandle(file);
+#else
+        munmap(const_cast<char*>(data), size);
+#endif
+    }
+    const char* getData() const { return data; }
+    size_t getSize() const { return size; }
+    /**
+     * Подсказка ОС заранее подгрузить страницы [offset; offset + len),
+     * чтобы обращение к ним не останавливало вычисления.
+     */
+    void prefetch(size_t offset, size_t len) const
+    {
+#ifndef _WIN32
+        static const size_t page = sysconf(_SC_PAGESIZE);
+        if (offset >= size) return;
+        size_t from = offset / page * page;
+        len = std::min(size - from, offset - from + len);
+        madvise(const_cast<char*>(data) + from, len, MADV_WILLNEED);
+#else
+        // PrefetchVirtualMemory есть не во всех версиях Windows,
+        // поэтому страницы подгружаются при обращении
+        (void)offset;
+        (void)len;
+#endif
+    }
+};
+
+/**
+ * Табличная функция: отсчёты (x, y) из файла, отображённого в память,
+ * с линейной или кубической (Эрмита) интерполяцией между ними.
+ * Формат файла: "TAB1", uint32 0, uint64 n, n значений x по
+ * возрастанию, n значений y (всё - double в порядке байт машины).
+ * Для поиска отрезка в куче хранится только каждый BLOCK-й x в
+ * порядке Эйцингера (дерево поиска в массиве, обход в ширину), а
+ * внутри блока поиск идёт прямо по отображённому файлу.
+ * Возрастание x конструктор проверяет только по первым x блоков
+ * (это всё равно читает каждую страницу столбца x, но не y, и
+ * сравнений в BLOCK раз меньше) и в первом и последнем блоках;
+ * остальные блоки проверяются при первом поиске в них.
+ */
+class TabulatedFunction : public Function
+{
+    static const size_t BLOCK = 64;     // отсчётов на элемент индекса
+
+    std::shared_ptr<MappedFile> file;   // отображённый файл
+    const double*           xs;         // абсциссы отсчётов
+    const double*           ys;         // значения
+    size_t                  count;      // кол-во отсчётов
+    bool                    cubic;      // кубическая интерполяция
+    std::vector<double>     tree;       // первые x блоков, порядок Эйцингера
+    std::vector<uint32_t>   blockOf;    // номер блока для узла дерева
+    std::unique_ptr<std::atomic<bool>[]> checked;   // x блока проверены
+
+    /**
+     * Заполнение дерева Эйцингера обходом в порядке возрастания.
+     */
+    void build(size_t node, size_t& next)
+    {
+        if (node >= tree.size()) return;
+        build(2 * node, next);
+        tree[node] = xs[next * BLOCK];
+        blockOf[node] = next++;
+        build(2 * node + 1, next);
+    }
+    /**
+     * Проверка возрастания x в блоке вместе с двумя отсчётами по обе
+     * стороны (их берёт интерполяция у края блока). Из разных потоков
+     * блок может проверяться дважды, это безвредно.
+     */
+    void checkBlock(size_t block) const
+    {
+        if (checked[block].load(std::memory_order_acquire))
+            return;
+        size_t from = block * BLOCK;
+        from = from > 2 ? from - 2 : 0;
+        size_t to = std::min(count - 1, (block + 1) * BLOCK + 2);
+        // при повторяющихся или неупорядоченных x интерполяция делит
+        // на ноль
+        for (size_t i = from; i < to; ++i) {
+            if (!(xs[i] < xs[i + 1]))
+                throw MyError("В табличном файле x не возрастают");
+        }
+        checked[block].store(true, std::memory_order_release);
+    }
+    /**
+     * Номер i отсчёта, такого что xs[i] <= x < xs[i + 1]
+     * (с прижатием к краям таблицы).
+     */
+    size_t locate(double x) const
+    {
+        // первый узел с ключом > x: спуск без ветвлений, затем
+        // отбрасываем хвост единиц (последние повороты направо)
+        size_t k = 1, n = tree.size();
+        while (k < n)
+            k = 2 * k + (tree[k] <= x);
+        while (k & 1) k >>= 1;
+        k >>= 1;
+        size_t blocks = n - 1;
+        size_t block = k ? blockOf[k] : blocks;
+        if (block > 0) --block;
+        checkBlock(block);
+        size_t from = block * BLOCK;
+        size_t to = std::min(count, from + BLOCK + 1);
+        size_t i = std::upper_bound(xs + from, xs + to, x) - xs;
+        if (i == 0) return 0;
+        return std::min(i - 1, count - 2);
+    }
+
+public:
+
+    TabulatedFunction(const std::string& title, const std::string& path,
+        bool spline) :
+        Function(("таблица " + title).c_str()),
+        file(std::make_shared<MappedFile>(path)),
+        xs(nullptr), ys(nullptr), count(0), cubic(spline),
+        tree(), blockOf(), checked()
+    {
+        const char* p = file->getData();
+        uint64_t n = 0;
+        if ((file->getSize() < 16) || (std::memcmp(p, "TAB1", 4) != 0))
+            throw MyError("Неверный формат табличного файла");
+        std::memcpy(&n, p + 8, sizeof(n));
+        // сравнение с размером файла без умножения n, которое может
+        // переполниться
+        if ((n < 2) || (n > (file->getSize() - 16) / (2 * sizeof(double))))
+            throw MyError("Неверный формат табличного файла");
+        count = n;
+        xs = reinterpret_cast<const double*>(p + 16);
+        ys = xs + count;
+        size_t blocks = (count + BLOCK - 1) / BLOCK;
+        // по первым x блоков выбирается блок, так что их порядок
+        // нужен сразу
+        for (size_t b = 1; b < blocks; ++b) {
+            if (!(xs[(b - 1) * BLOCK] < xs[b * BLOCK]))
+                throw MyError("В табличном файле x не возрастают");
+        }
+        checked.reset(new std::atomic<bool>[blocks]());
+        checkBlock(0);
+        checkBlock(blocks - 1);
+        tree.resize(blocks + 1);
+        blockOf.resize(blocks + 1);
+        size_t next = 0;
+        build(1, next);
+    }
+    /**
+     * Запись табличного файла с отсчётами функции fun на [a;b].
+     */
+    static void write(const std::string& path, const Function& fun,
+        double a, double b, uint64_t n)
+    {
+        if (n < 2)
+            throw MyError("Нужно хотя бы два отсчёта");
+        std::ofstream out(path, std::ios::binary);
+        if (!out)
+            throw MyError("Не удалось создать файл");
+        uint32_t zero = 0;
+        out.write("TAB1", 4);
+        out.write(reinterpret_cast<const char*>(&zero), sizeof(zero));
+        out.write(reinterpret_cast<const char*>(&n), sizeof(n));
+        const size_t CHUNK = 1 << 16;
+        std::vector<double> xbuf(CHUNK), ybuf(CHUNK);
+        for (int column = 0; column < 2; ++column) {
+            for (uint64_t i = 0; i < n; i += CHUNK) {
+                size_t k = std::min<uint64_t>(CHUNK, n - i);
+                for (size_t j = 0; j < k; ++j)
+                    xbuf[j] = a + (b - a) * double(i + j) / double(n - 1);
+                if (column == 1)
+                    fun.calcValues(xbuf.data(), ybuf.data(), k);
+                const std::vector<double>& buf = column == 0 ? xbuf : ybuf;
+                out.write(reinterpret_cast<const char*>(buf.data()),
+                    k * sizeof(double));
+            }
+        }
+        if (!out)
+            throw MyError("Ошибка записи файла");
+    }
+
+protected:
+
+    virtual double f(double x) const
+    {
+        size_t i = locate(x);
+        double x0 = xs[i], x1 = xs[i + 1];
+        double y0 = ys[i], y1 = ys[i + 1];
+        double h = x1 - x0;
+        double t = (x - x0) / h;
+        // вне таблицы - продолжение крайнего отрезка по прямой
+        if (!cubic || (t < 0) || (t > 1))
+            return y0 + (y1 - y0) * t;
+        // касательные по соседним отсчётам (сплайн Катмулла-Рома)
+        double s = (y1 - y0) / h;
+        double m0 = i > 0 ? ((y0 - ys[i - 1]) / (x0 - xs[i - 1]) + s) / 2 : s;
+        double m1 = i + 2 < count ? ((ys[i + 2] - y1) / (xs[i + 2] - x1) + s) / 2 : s;
+        double t2 = t * t, t3 = t2 * t;
+        return (2 * t3 - 3 * t2 + 1) * y0 + (t3 - 2 * t2 + t) * h * m0
+            + (-2 * t3 + 3 * t2) * y1 + (t3 - t2) * h * m1;
+    }
+};
+
+/**
+ * Функция, заданная выражением от x. Выражение компилируется в одну
+ * программу, в том числе когда оно собрано из других функций; вторая
+ * программа считает вместе f, f' и f'' по символьным производным.
+ * Программы берутся из кэша компиляции, дерево лежит в арене функции
+ * и освобождается вместе с этой версией функции.
+ */
+class ExpressionFunction : public Function
+{
+    Arena       arena;      // память дерева
+    Expression  expr;       // дерево выражения
+    std::shared_ptr<const CompiledExpression> compiled;
+
+public:
+    ExpressionFunction(const std::string& text,
+        const Expression::Resolver& resolver = Expression::Resolver()) :
+        Function(text.c_str()), arena(1024), expr(text, resolver, &arena),
+        compiled(CompileCache::instance().get(expr))
+    {
+        if (compiled->program.usesParam())
+            throw MyError("Выражение с параметром p - это семейство функций");
+    }
+    ExpressionFunction(const std::string& text, const Expression& e) :
+        Function(text.c_str()), arena(1024), expr(e, &arena),
+        compiled(CompileCache::instance().get(expr))
+    {
+        if (compiled->program.usesParam())
+            throw MyError("Выражение с параметром p - это семейство функций");
+    }
+    virtual const Expression* getExpression() const
+    {
+        return &expr;
+    }
+protected:
+    virtual double f(double x) const
+    {
+        return compiled->program.eval(x, 0.0);
+    }
+    virtual Interval fi(const Interval& x) const
+    {
+        return compiled->program.eval(x, Interval(0.0));
+    }
+    virtual void fv(const double* xs, double* ys, size_t n) const
+    {
+        compiled->program.evalMany(xs, ys, n, 0.0);
+    }
+    virtual void fvf(const float* xs, float* ys, size_t n) const
+    {
+        compiled->program.evalMany(xs, ys, n, 0.0f);
+    }
+    virtual bool fd(double x, double* d) const
+    {
+        compiled->derivs.evalAll(x, 0.0, d);
+        return true;
+    }
+};
+
+/**
+ * Семейство функций, заданное выражением от x и p.
+ */
+class ExpressionFamily : public ParametricFunction
+{
+    std::shared_ptr<const CompiledExpression> compiled;
+
+public:
+    ExpressionFamily(const std::string& text,
+        const Expression::Resolver& resolver = Expression::Resolver()) :
+        ParametricFunction(text.c_str()),
+        compiled(CompileCache::instance().get(Expression(text, resolver)))
+    {
+    }
+protected:
+    virtual double f(double x, double p) const
+    {
+        return compiled->program.eval(x, p);
+    }
+};
+
+/**
+ * Объединение функций, у которых есть выражение, в одну функцию с
+ * одной скомпилированной программой: без виртуального вызова на
+ * каждую составную часть и без промежуточных массивов при пакетном
+ * вычислении.
+ */
+class Combine
+{
+    static const Expression& expression(const Function& f)
+    {
+        const Expression* e = f.getExpression();
+        if (!e)
+            throw MyError("Функцию нельзя объединять с другими");
+        return *e;
+    }
+    static std::string text(const Function& f)
+    {
+        return "(" + f.getName().substr(4) + ")";
+    }
+    static std::shared_ptr<const Function> make(const std::string& name,
+        const Expression& e)
+    {
+        return std::make_shared<ExpressionFunction>(name, e);
+    }
+
+public:
+    static std::shared_ptr<const Function> sum(const Function& a, const Function& b)
+    {
+        return make(text(a) + " + " + text(b), Expression::combine(
+            Expression::OP_ADD, expression(a), expression(b)));
+    }
+    static std::shared_ptr<const Function> product(const Function& a, const Function& b)
+    {
+        return make(text(a) + " * " + text(b), Expression::combine(
+            Expression::OP_MUL, expression(a), expression(b)));
+    }
+    static std::shared_ptr<const Function> scale(double k, const Function& a)
+    {
+        std::ostringstream oss;
+        oss.imbue(std::locale::classic());
+        oss << std::setprecision(17) << k;
+        return make(oss.str() + "*" + text(a), Expression::combine(
+            Expression::OP_MUL, Expression::constant(k), expression(a)));
+    }
+    /**
+     * Композиция outer(inner(x)). В тексте outer заменяются только
+     * имена x целиком (как их выделяет разбор выражения), а не буква
+     * x внутри других имён, например exp.
+     */
+    static std::shared_ptr<const Function> compose(const Function& outer,
+        const Function& inner)
+    {
+        std::string from = outer.getName().substr(4), name;
+        std::string arg = text(inner);
+        for (size_t i = 0; i < from.size();) {
+            size_t j = i;
+            while ((j < from.size()) && isalpha((unsigned char)from[j])) ++j;
+            if (j == i) {
+                name += from[i++];
+                continue;
+            }
+            if ((j - i == 1) && (from[i] == 'x'))
+                name += arg;
+            else
+                name.append(from, i, j - i);
+            i = j;
+        }
+        return make(name, Expression::compose(expression(outer), expression(inner)));
+    }
+};
+
+/**
+ * Объединение функций во время компиляции (expression templates):
+ * выражение из узлов ниже становится одним типом, и его значение -
+ * одна встроенная функция без виртуальных вызовов. Узлы работают с
+ * double, float и Interval.
+ */
+struct FxNode {};
+
+struct FxX : FxNode
+{
+    template <typename T> T operator()(const T& x) const { return x; }
+};
+struct FxConst : FxNode
+{
+    double c;
+    FxConst(double v) : c(v) {}
+    template <typename T> T operator()(const T&) const { return T(c); }
+};
+template <class A, class B> struct FxAdd : FxNode
+{
+    A a; B b;
+    FxAdd(const A& l, const B& r) : a(l), b(r) {}
+    template <typename T> T operator()(const T& x) const { return a(x) + b(x); }
+};
+template <class A, class B> struct FxMul : FxNode
+{
+    A a; B b;
+    FxMul(const A& l, const B& r) : a(l), b(r) {}
+    template <typename T> T operator()(const T& x) const { return a(x) * b(x); }
+};
+template <class A> struct FxSqr : FxNode
+{
+    A a;
+    FxSqr(const A& v) : a(v) {}
+    template <typename T> T operator()(const T& x) const { return ExprOps<T>::sqr(a(x)); }
+};
+template <class A> struct FxSin : FxNode
+{
+    A a;
+    FxSin(const A& v) : a(v) {}
+    template <typename T> T operator()(const T& x) const { return ExprOps<T>::sin(a(x)); }
+};
+
+template <class A> using FxIf = typename std::enable_if<
+    std::is_base_of<FxNode, A>::value>::type;
+
+template <class A, class B, class = FxIf<A>, class = FxIf<B>>
+FxAdd<A, B> operator+(const A& a, const B& b) { return FxAdd<A, B>(a, b); }
+template <class A, class B, class = FxIf<A>, class = FxIf<B>>
+FxMul<A, B> operator*(const A& a, const B& b) { return FxMul<A, B>(a, b); }
+template <class A, class = FxIf<A>>
+FxMul<FxConst, A> operator*(double k, const A& a) { return FxMul<FxConst, A>(k, a); }
+template <class A, class = FxIf<A>>
+FxSqr<A> fxSqr(const A& a) { return FxSqr<A>(a); }
+template <class A, class = FxIf<A>>
+FxSin<A> fxSin(const A& a) { return FxSin<A>(a); }
+
+/**
+ * Функция из выражения E, собранного во время компиляции. Текст
+ * функции должен разбираться как выражение: по нему строятся точные
+ * производные.
+ */
+template <class E> class FusedFunction : public Function
+{
+    E       expr;
+    Program derivs; // f, f' и f''
+
+public:
+    FusedFunction(const char* text, const E& e) :
+        Function(text), expr(e), derivs(Program::derivatives(Expression(text)))
+    {
+    }
+
+protected:
+    virtual double f(double x) const
+    {
+        return expr(x);
+    }
+    virtual Interval fi(const Interval& x) const
+    {
+        return expr(x);
+    }
+    virtual void fv(const double* xs, double* ys, size_t n) const
+    {
+        for (size_t i = 0; i < n; ++i)
+            ys[i] = expr(xs[i]);
+    }
+    virtual void fvf(const float* xs, float* ys, size_t n) const
+    {
+        for (size_t i = 0; i < n; ++i)
+            ys[i] = expr(xs[i]);
+    }
+    virtual bool fd(double x, double* d) const
+    {
+        derivs.evalAll(x, 0.0, d);
+        return true;
+    }
+};
+
+/**
+ * a*x^2 + b*sin(c*x), собранная во время компиляции.
+ */
+inline std::shared_ptr<const Function> makeSquareSin(double a, double b, double c,
+    const char* text)
+{
+    FxX x;
+    auto e = a * fxSqr(x) + b * fxSin(c * x);
+    return std::make_shared<FusedFunction<decltype(e)>>(text, e);
+}
+
+/**
+ * Описание функции, которое возвращает модуль (плагин). Модуль - это
+ * разделяемая библиотека (.so/.dll), экспортирующая функцию
+ *   extern "C" const OptPlugin* optimizer_plugin_v1(void);
+ * Структура не меняется в пределах версии abi, указатель должен
+ * оставаться действительным, пока модуль загружен. eval обязательна,
+ * evalBatch (значения сразу в n точках) - нет; обе должны допускать
+ * вызов из нескольких потоков.
+ */
+struct OptPlugin
+{
+    uint32_t    abi;        // версия, PluginFunction::ABI
+    const char* name;       // текст функции, например "x^4 - x"
+    double      (*eval)(double x);
+    void        (*evalBatch)(const double* xs, double* ys, size_t n);
+};
+
+/**
+ * Функция из модуля, загруженного во время работы (dlopen/LoadLibrary).
+ */
+class PluginFunction : public Function
+{
+public:
+    static const uint32_t ABI = 1;  // поддерживаемая версия
+
+private:
+    std::shared_ptr<void>   library;    // модуль, выгружается последним
+    const OptPlugin*        plugin;     // описание функции
+
+    /**
+     * Загрузка модуля и проверка описания (до конструктора Function,
+     * которому нужен текст функции). Загружается временная копия
+     * файла: загрузчик ОС по тому же пути вернул бы уже загруженный
+     * модуль, и обновить функцию, заменив файл, было бы нельзя.
+     */
+    static const OptPlugin* open(const std::string& path,
+        std::shared_ptr<void>& library)
+    {
+        typedef const OptPlugin* (*Entry)();
+#ifdef _WIN32
+        char dir[MAX_PATH], copy[MAX_PATH];
+        if (!GetTempPathA(MAX_PATH, dir) || !GetTempFileNameA(dir, "opt", 0, copy)
+            || !CopyFileA(path.c_str(), copy, FALSE))
+            throw MyError("Не удалось загрузить модуль");
+        HMODULE handle = LoadLibraryA(copy);
+        if (!handle) {
+            DeleteFileA(copy);
+            throw MyError("Не удалось загрузить модуль");
+        }
+        std::string name(copy);
+        library.reset(handle, [name](void* h) {
+            FreeLibrary(HMODULE(h));
+            DeleteFileA(name.c_str());
+        });
+        Entry entry = reinterpret_cast<Entry>(
+            GetProcAddress(handle, "optimizer_plugin_v1"));
+#else
+        char copy[] = "/tmp/optplugin-XXXXXX";
+        int fd = mkstemp(copy);
+        if (fd < 0)
+            throw MyError("Не удалось загрузить модуль");
+        {
+            std::ifstream in(path, std::ios::binary);
+            std::ofstream out(copy, std::ios::binary);
+            out << in.rdbuf();
+            if (!in || !out) {
+                close(fd);
+                unlink(copy);
+                throw MyError("Не удалось загрузить модуль");
+            }
+        }
+        close(fd);
+        void* handle = dlopen(copy, RTLD_NOW | RTLD_LOCAL);
+        unlink(copy);   // отображение модуля в память остаётся
+        if (!handle)
+            throw MyError("Не удалось загрузить модуль");
+        library.reset(handle, [](void* h) { dlclose(h); });
+        Entry entry = reinterpret_cast<Entry>(
+            dlsym(handle, "optimizer_plugin_v1"));
+#endif
+        if (!entry)
+            throw MyError("В модуле нет функции optimizer_plugin_v1");
+        const OptPlugin* plugin = entry();
+        if (!plugin || (plugin->abi != ABI) || !plugin->eval || !plugin->name)
+            throw MyError("Модуль несовместимой версии");
+        return plugin;
+    }
+
+    PluginFunction(std::shared_ptr<void> lib, const OptPlugin* p) :
+        Function(p->name), library(std::move(lib)), plugin(p)
+    {
+    }
+
+public:
+
+    /**
+     * Загрузка функции из модуля path.
+     */
+    static std::shared_ptr<PluginFunction> load(const std::string& path)
+    {
+        std::shared_ptr<void> library;
+        const OptPlugin* plugin = open(path, library);
+        return std::shared_ptr<PluginFunction>(
+            new PluginFunction(std::move(library), plugin));
+    }
+
+protected:
+    virtual double f(double x) const
+    {
+        return plugin->eval(x);
+    }
+    virtual void fv(const double* xs, double* ys, size_t n) const
+    {
+        if (plugin->evalBatch) {
+            plugin->evalBatch(xs, ys, n);
+            return;
+        }
+        for (size_t i = 0; i < n; ++i)
+            ys[i] = plugin->eval(xs[i]);
+    }
+};
+
+/**
+ * Освобождение памяти по эпохам (epoch-based reclamation). Поток,
+ * работающий с объектами из реестра, на это время занимает слот и
+ * записывает в него текущую эпоху. Замещённый объект не удаляется
+ * сразу, а откладывается с номером эпохи; удаляется он, когда все
+ * занятые слоты ушли в более поздние эпохи, то есть никто из
+ * начавших работу до замены его уже не использует. Вход и выход -
+ * одна атомарная операция, без блокировок.
+ */
+class Epochs
+{
+    static const int SLOTS = 64;    // одновременно работающих потоков
+
+    std::atomic<uint64_t>   global;         // текущая эпоха
+    std::atomic<uint64_t>   pinned[SLOTS];  // эпоха потока в слоте, 0 - свободен
+    std::atomic<size_t>     pending;        // кол-во отложенных объектов
+    std::mutex              mtx;            // для отложенных объектов
+    std::vector<std::pair<uint64_t, std::shared_ptr<const void>>> retired;
+    size_t                  reclaimed;      // кол-во удалённых
+
+public:
+
+    /**
+     * Занятый слот на время жизни объекта.
+     */
+    class Guard
+    {
+        Epochs* owner;
+        int     slot;
+
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+
+    public:
+        Guard(Epochs& e) : owner(&e), slot(-1)
+        {
+            while (true) {
+                for (int i = 0; i < SLOTS; ++i) {
+                    uint64_t expected = 0;
+                    if (e.pinned[i].compare_exchange_strong(expected,
+                        e.global.load())) {
+                        slot = i;
+                        return;
+                    }
+                }
+                std::this_thread::yield();
+            }
+        }
+        Guard(Guard&& other) : owner(other.owner), slot(other.slot)
+        {
+            other.slot = -1;
+        }
+        ~Guard()
+        {
+            if (slot < 0) return;
+            owner->pinned[slot].store(0);
+            if (owner->pending.load())
+                owner->collect();
+        }
+    };
+
+    Epochs() : global(1), pending(0), mtx(), retired(), reclaimed(0)
+    {
+        for (auto& p : pinned) p.store(0);
+    }
+    /**
+     * Отложенное удаление объекта, уже недоступного новым читателям.
+     */
+    void retire(std::shared_ptr<const void> obj)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            retired.emplace_back(global.fetch_add(1), std::move(obj));
+            pending.store(retired.size());
+        }
+        collect();
+    }
+    /**
+     * Удаление отложенных объектов, которые никто уже не может видеть.
+     */
+    void collect()
+    {
+        std::vector<std::shared_ptr<const void>> dead;
+        {
+            std::unique_lock<std::mutex> lock(mtx, std::try_to_lock);
+            if (!lock.owns_lock()) return;
+            // слоты - только под блокировкой: иначе между просмотром и
+            // блокировкой другой поток успеет отложить объект, который
+            // видит только что вошедший читатель, и он будет удалён
+            uint64_t oldest = UINT64_MAX;
+            for (auto& p : pinned) {
+                uint64_t e = p.load();
+                if (e) oldest = std::min(oldest, e);
+            }
+            auto keep = std::stable_partition(retired.begin(), retired.end(),
+                [oldest](const std::pair<uint64_t, std::shared_ptr<const void>>& r) {
+                    return r.first >= oldest;
+                });
+            for (auto it = keep; it != retired.end(); ++it)
+                dead.push_back(std::move(it->second));
+            retired.erase(keep, retired.end());
+            reclaimed += dead.size();
+            pending.store(retired.size());
+        }
+        // удаление (деструкторы функций) - вне блокировки
+    }
+    size_t getPending() const { return pending.load(); }
+    size_t getReclaimed()
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        return reclaimed;
+    }
+};
+
+/**
+ * Реестр функций и семейств. Каждая функция получает постоянный номер
+ * (в порядке добавления) и уникальное имя. Читатели не ждут
+ * изменяющих: читатель атомарно берёт текущий неизменяемый снимок
+ * реестра, а изменение строит новый снимок и атомарно подменяет им
+ * старый (по образцу RCU). Атомарный shared_ptr - std::atomic из
+ * C++20, если он есть, иначе std::atomic_load/atomic_store. Ни то,
+ * ни другое в libstdc++ не lock-free: на время копирования указателя
+ * берётся короткая блокировка (мьютекс из общего пула или спин-бит в
+ * самом указателе), но не на время, пока писатель строит снимок.
+ * Имя ищется в обычной хэш-таблице, а не через совершенное
+ * хэширование, и каждое добавление копирует весь снимок, O(n):
+ * реестр рассчитан на десятки функций, а не на частую регистрацию.
+ * Определение функции можно заменить новой версией под тем же
+ * номером; старая версия удаляется по эпохам, когда
+ * закончатся начатые с ней решения. Поэтому ссылку из get() можно
+ * использовать, только пока жив объект pin().
+ */
+class FunctionRegistry
+{
+    template <typename F> struct Table
+    {
+        std::vector<std::shared_ptr<const F>>   items;      // по номеру
+        std::vector<std::string>                names;      // по номеру
+        std::vector<int>                        revisions;  // по номеру
+        std::unordered_map<std::string, int>    ids;        // номер по имени
+    };
+    struct Snapshot
+    {
+        Table<Function>             functions;
+        Table<ParametricFunction>   families;
+    };
+
+#ifdef __cpp_lib_atomic_shared_ptr
+    std::atomic<std::shared_ptr<const Snapshot>> snapshot; // текущий снимок
+#else
+    std::shared_ptr<const Snapshot> snapshot;   // текущий снимок
+#endif
+    std::mutex                      writer;     // для изменяющих
+    mutable Epochs                  epochs;     // замещённые версии
+
+    FunctionRegistry(const FunctionRegistry&) = delete;
+    FunctionRegistry& operator=(const FunctionRegistry&) = delete;
+
+    std::shared_ptr<const Snapshot> load() const
+    {
+#ifdef __cpp_lib_atomic_shared_ptr
+        return snapshot.load();
+#else
+        return std::atomic_load(&snapshot);
+#endif
+    }
+    void store(std::shared_ptr<const Snapshot> next)
+    {
+#ifdef __cpp_lib_atomic_shared_ptr
+        snapshot.store(std::move(next));
+#else
+        std::atomic_store(&snapshot, std::move(next));
+#endif
+    }
+    /**
+     * Добавление в таблицу нового снимка (вызывается под writer).
+     * Если replace и имя уже есть - замена определения, старое
+     * возвращается в old.
+     */
+    template <typename F> static int insert(Table<F>& table,
+        const std::string& name, std::shared_ptr<const F> item, bool replace,
+        std::shared_ptr<const F>& old)
+    {
+        auto it = table.ids.find(name);
+        if (it != table.ids.end()) {
+            if (!replace)
+                throw MyError("Функция с таким именем уже есть");
+            old = std::move(table.items[it->second]);
+            table.items[it->second] = std::move(item);
+            ++table.revisions[it->second];
+            return it->second;
+        }
+        int id = table.items.size();
+        table.items.push_back(std::move(item));
+        table.names.push_back(name);
+        table.revisions.push_back(1);
+        table.ids[name] = id;
+        return id;
+    }
+    /**
+     * Изменение одной из таблиц снимка.
+     */
+    template <typename F> int change(Table<F> Snapshot::* table,
+        const std::string& name, std::shared_ptr<const F> item, bool replace)
+    {
+        std::shared_ptr<const F> old;
+        int id;
+        {
+            std::lock_guard<std::mutex> lock(writer);
+            auto next = std::make_shared<Snapshot>(*load());
+            id = insert((*next).*table, name, std::move(item), replace, old);
+            store(std::move(next));
+        }
+        if (old)
+            epochs.retire(std::move(old));
+        return id;
+    }
+    template <typename F> static int lookup(const Table<F>& table,
+        const std::string& name)
+    {
+        auto it = table.ids.find(name);
+        return it == table.ids.end() ? -1 : it->second;
+    }
+    /**
+     * Имя по умолчанию - текст функции без "y = ".
+     */
+    static std::string defaultName(const std::string& text)
+    {
+        return text.substr(4);
+    }
+
+public:
+
+    FunctionRegistry() :
+        snapshot(std::make_shared<const Snapshot>()), writer(), epochs()
+    {
+        add(std::make_shared<Square>());
+        add(std::make_shared<Sin>());
+        add(makeSquareSin(0.5, 1.0, 3.0, "0.5*x^2 + sin(3*x)"));
+        addFamily(std::make_shared<ShiftedSquare>());
+        addFamily(std::make_shared<ShiftedSin>());
+    }
+    /**
+     * Защита от удаления функций, полученных из реестра, на время
+     * жизни возвращаемого объекта.
+     */
+    Epochs::Guard pin() const
+    {
+        return Epochs::Guard(epochs);
+    }
+    /**
+     * Добавление функции под именем name (пустое - по тексту функции).
+     * Возвращает номер функции.
+     */
+    int add(std::shared_ptr<const Function> fun, const std::string& name = "")
+    {
+        std::string key = name.empty() ? defaultName(fun->getName()) : name;
+        return change(&Snapshot::functions, key, std::move(fun), false);
+    }
+    /**
+     * Добавление функции под именем по её тексту, если функции с тем
+     * же текстом ещё нет; иначе - номер имеющейся. Если имя занято
+     * другой функцией, к нему добавляется " #2", " #3" и т.д.
+     */
+    int addUnique(std::shared_ptr<const Function> fun)
+    {
+        std::string base = defaultName(fun->getName());
+        std::shared_ptr<const Function> old;
+        int id;
+        {
+            std::lock_guard<std::mutex> lock(writer);
+            std::shared_ptr<const Snapshot> snap = load();
+            std::string key = base;
+            for (int k = 2; ; ++k) {
+                id = lookup(snap->functions, key);
+                if (id < 0)
+                    break;
+                if (snap->functions.items[id]->getName() == fun->getName())
+                    return id;
+                key = base + " #" + std::to_string(k);
+            }
+            auto next = std::make_shared<Snapshot>(*snap);
+            id = insert(next->functions, key, std::move(fun), false, old);
+            store(std::move(next));
+        }
+        return id;
+    }
+    /**
+     * Добавление семейства функций. Возвращает номер семейства.
+     */
+    int addFamily(std::shared_ptr<const ParametricFunction> fam,
+        const std::string& name = "")
+    {
+        std::string key = name.empty() ? defaultName(fam->getName()) : name;
+        return change(&Snapshot::families, key, std::move(fam), false);
+    }
+    /**
+     * Добавление функции или новой версии функции с тем же именем.
+     */
+    int replace(const std::string& name, std::shared_ptr<const Function> fun)
+    {
+        return change(&Snapshot::functions, name, std::move(fun), true);
+    }
+    /**
+     * Добавление функции или семейства (если есть параметр p),
+     * заданных выражением. Функция с тем же именем заменяется новой
+     * версией. Возвращает номер.
+     */
+    int define(const std::string& name, const std::string& text, bool& family)
+    {
+        // вызовы других функций подставляются на момент определения
+        std::shared_ptr<const Snapshot> snap = load();
+        Expression::Resolver resolver = [snap](const std::string& callee) {
+            int id = lookup(snap->functions, callee);
+            return id < 0 ? nullptr : snap->functions.items[id]->getExpression();
+        };
+        family = Expression(text, resolver).usesParam();
+        if (family) {
+            return change(&Snapshot::families, name,
+                std::shared_ptr<const ParametricFunction>(
+                    std::make_shared<ExpressionFamily>(text, resolver)), true);
+        }
+        return replace(name, std::make_shared<ExpressionFunction>(text, resolver));
+    }
+    /**
+     * Номер функции по имени или -1.
+     */
+    int find(const std::string& name) const
+    {
+        return lookup(load()->functions, name);
+    }
+    /**
+     * Номер семейства по имени или -1.
+     */
+    int findFamily(const std::string& name) const
+    {
+        return lookup(load()->families, name);
+    }
+    /**
+     * Функция по номеру (действительна, пока жив объект pin()).
+     */
+    const Function& get(int index) const
+    {
+        std::shared_ptr<const Snapshot> snap = load();
+        int fsize = snap->functions.items.size();
+        if ((index < 0) || (index >= fsize))
+            throw MyError("Неверный индекс функции");
+        return *snap->functions.items[index];
+    }
+    /**
+     * Имя функции по номеру.
+     */
+    std::string getKey(int index) const
+    {
+        std::shared_ptr<const Snapshot> snap = load();
+        int fsize = snap->functions.names.size();
+        if ((index < 0) || (index >= fsize))
+            throw MyError("Неверный индекс функции");
+        return snap->functions.names[index];
+    }
+    /**
+     * Номер версии определения функции (с 1).
+     */
+    int getRevision(int index) const
+    {
+        std::shared_ptr<const Snapshot> snap = load();
+        int fsize = snap->functions.revisions.size();
+        if ((index < 0) || (index >= fsize))
+            throw MyError("Неверный индекс функции");
+        return snap->functions.revisions[index];
+    }
+    /**
+     * Кол-во функций.
+     */
+    int getSize() const
+    {
+        return load()->functions.items.size();
+    }
+    /**
+     * Семейство функций по номеру (действительно, пока жив pin()).
+     */
+    const ParametricFunction& getFamily(int index) const
+    {
+        std::shared_ptr<const Snapshot> snap = load();
+        int fsize = snap->families.items.size();
+        if ((index < 0) || (index >= fsize))
+            throw MyError("Неверный индекс семейства функций");
+        return *snap->families.items[index];
+    }
+    /**
+     * Кол-во семейств функций.
+     */
+    int getFamilyCount() const
+    {
+        return load()->families.items.size();
+    }
+    /**
+     * Замещённые версии: ещё не удалённые и удалённые.
+     */
+    size_t getRetired() const { return epochs.getPending(); }
+    size_t getReclaimed() const { return epochs.getReclaimed(); }
+};
+
+/**
+ * Чебышёвская аппроксимация гладкой функции на отрезке [a;b].
+ * Строится интерполяцией в точках Чебышёва с удвоением их числа,
+ * пока хвост коэффициентов не станет пренебрежимо мал.
+ */
+class ChebyshevProxy
+{
+    double              a;      // левый конец отрезка
+    double              b;      // правый конец отрезка
+    std::vector<double> coeffs; // коэффициенты ряда по многочленам Чебышёва
+    int                 evals;  // кол-во вычислений функции при построении
+
+    static const int MIN_DEGREE = 16;
+    static const int MAX_DEGREE = 1 << 16;
+
+    ChebyshevProxy(double l, double r) : a(l), b(r), coeffs(), evals(0) {}
+
+    /**
+     * Быстрое преобразование Фурье (n - степень двойки).
+     */
+    static void fft(std::vector<std::complex<double>>& v)
+    {
+        const double pi = 3.14159265358979323846;
+        size_t n = v.size();
+        for (size_t i = 1, j = 0; i < n; ++i) {
+            size_t bit = n >> 1;
+            for (; j & bit; bit >>= 1) j ^= bit;
+            j ^= bit;
+            if (i < j) std::swap(v[i], v[j]);
+        }
+        for (size_t len = 2; len <= n; len <<= 1) {
+            std::complex<double> w(std::cos(-2 * pi / len),
+                std::sin(-2 * pi / len));
+            for (size_t i = 0; i < n; i += len) {
+                std::complex<double> wk(1.0, 0.0);
+                for (size_t k = 0; k < len / 2; ++k) {
+                    std::complex<double> u = v[i + k];
+                    std::complex<double> t = v[i + k + len / 2] * wk;
+                    v[i + k] = u + t;
+                    v[i + k + len / 2] = u - t;
+                    wk *= w;
+                }
+            }
+        }
+    }
+    /**
+     * Коэффициенты по значениям в n + 1 точке Чебышёва (ДКП-I через БПФ
+     * чётного продолжения).
+     */
+    static std::vector<double> transform(const std::vector<double>& values)
+    {
+        size_t n = values.size() - 1;
+        std::vector<std::complex<double>> v(2 * n);
+        for (size_t k = 0; k <= n; ++k) v[k] = values[k];
+        for (size_t k = 1; k < n; ++k) v[2 * n - k] = values[k];
+        fft(v);
+        std::vector<double> c(n + 1);
+        for (size_t j = 0; j <= n; ++j) c[j] = v[j].real() / n;
+        c[0] /= 2;
+        c[n] /= 2;
+        return c;
+    }
+    /**
+     * Сумма ряда c в точке t из [-1;1] (схема Кленшоу).
+     */
+    static double clenshaw(const std::vector<double>& c, double t)
+    {
+        double b1 = 0.0, b2 = 0.0;
+        for (size_t j = c.size(); j-- > 1; ) {
+            double b0 = 2 * t * b1 - b2 + c[j];
+            b2 = b1;
+            b1 = b0;
+        }
+        return t * b1 - b2 + c[0];
+    }
+    /**
+     * Коэффициенты производной ряда c по t.
+     */
+    static std::vector<double> derivative(const std::vector<double>& c)
+    {
+        size_t n = c.size() - 1;
+        if (n == 0) return std::vector<double>(1, 0.0);
+        std::vector<double> d(n + 2, 0.0);
+        for (size_t k = n; k >= 1; --k)
+            d[k - 1] = d[k + 1] + 2.0 * k * c[k];
+        d[0] /= 2;
+        d.resize(n);
+        return d;
+    }
+    double toT(double x) const { return (2 * x - a - b) / (b - a); }
+    double toX(double t) const { return (a + b) / 2 + (b - a) / 2 * t; }
+    /**
+     * Знак ряда c на [-1;1] постоянен: первый коэффициент больше суммы
+     * остальных по модулю с запасом tol на ошибки округления.
+     */
+    static bool definite(const std::vector<double>& c, double tol)
+    {
+        double rest = 0.0;
+        for (size_t j = 1; j < c.size(); ++j) rest += std::fabs(c[j]);
+        return std::fabs(c[0]) > rest + tol;
+    }
+    /**
+     * Ряд c с t из [-1;1], пересчитанный на часть [lo;hi] (тот же
+     * многочлен от новой переменной); пренебрежимо малые старшие
+     * коэффициенты (до tol) отбрасываются.
+     */
+    static std::vector<double> part(const std::vector<double>& c,
+        double lo, double hi, double tol)
+    {
+        const double pi = 3.14159265358979323846;
+        size_t n = 2;
+        while (n + 1 < c.size()) n *= 2;
+        std::vector<double> values(n + 1);
+        for (size_t k = 0; k <= n; ++k)
+            values[k] = clenshaw(c, (lo + hi) / 2 + (hi - lo) / 2 * std::cos(pi * k / n));
+        std::vector<double> local = transform(values);
+        while ((local.size() > 1) && (std::fabs(local.back()) <= tol))
+            local.pop_back();
+        return local;
+    }
+    /**
+     * Минимумы на части [lo;hi] отрезка t: d - производная по t,
+     * local - она же на этой части. Часть, где производная не меняет
+     * знак, отбрасывается; где монотонна (знак второй производной
+     * постоянен) - корень ищется делением пополам по знакам на концах;
+     * иначе часть делится пополам. Так близкие корни производной не
+     * теряются внутри одной клетки сетки.
+     */
+    void minimaIn(const std::vector<double>& d, const std::vector<double>& local,
+        double lo, double hi, double tol, std::vector<double>& result) const
+    {
+        if (definite(local, tol))
+            return;
+        // концы - по общему ряду, чтобы соседние части не расходились
+        double dlo = clenshaw(d, lo), dhi = clenshaw(d, hi);
+        bool monotone = (local.size() <= 2) || definite(derivative(local), tol);
+        double mid = lo + (hi - lo) / 2;
+        if (!monotone && (mid > lo) && (mid < hi) && (hi - lo > 1e-12)) {
+            minimaIn(d, part(local, -1.0, 0.0, tol), lo, mid, tol, result);
+            minimaIn(d, part(local, 0.0, 1.0, tol), mid, hi, tol, result);
+            return;
+        }
+        if (!((dlo < 0) && (dhi >= 0)))
+            return;
+        while (true) {
+            double m = lo + (hi - lo) / 2;
+            if ((m <= lo) || (m >= hi)) break;
+            if (clenshaw(d, m) < 0) lo = m; else hi = m;
+        }
+        double t = lo + (hi - lo) / 2;
+        if ((t > -1.0) && (t < 1.0)) result.push_back(toX(t));
+    }
+
+public:
+
+    /**
+     * Значения функции в n точках xs (в ys); false - построение нужно
+     * прервать.
+     */
+    using Values = std::function<bool(const double*, double*, size_t)>;
+
+    /**
+     * Построение аппроксимации функции на [l;r] с относительной
+     * точностью tol по значениям от eval. Если eval прервал
+     * построение, аппроксимация пуста (см. isBuilt()).
+     */
+    static ChebyshevProxy build(const Values& eval, double l, double r,
+        double tol)
+    {
+        const double pi = 3.14159265358979323846;
+        ChebyshevProxy proxy(l, r);
+        std::vector<double> values;
+        std::vector<double> xs, ys;
+        for (int n = MIN_DEGREE; n <= MAX_DEGREE; n *= 2) {
+            // точки прошлого шага совпадают с чётными точками нового
+            std::vector<double> next(n + 1);
+            xs.clear();
+            for (int k = 0; k <= n; ++k) {
+                if (!values.empty() && (k % 2 == 0))
+                    next[k] = values[k / 2];
+                else
+                    xs.push_back(proxy.toX(std::cos(pi * k / n)));
+            }
+            ys.resize(xs.size());
+            if (!eval(xs.data(), ys.data(), xs.size()))
+                return proxy;
+            proxy.evals += xs.size();
+            for (int k = 0, i = 0; k <= n; ++k) {
+                if (values.empty() || (k % 2 != 0))
+                    next[k] = ys[i++];
+            }
+            values.swap(next);
+
+            std::vector<double> c = transform(values);
+            double scale = 0.0;
+            for (double cj : c) scale = std::max(scale, std::fabs(cj));
+            if (!(scale == scale) || std::isinf(scale))
+                throw MyError("Функция не определена на отрезке");
+            double tail = std::max(std::fabs(c[n]),
+                std::max(std::fabs(c[n - 1]), std::fabs(c[n - 2])));
+            if (tail <= tol * scale) {
+                size_t last = n;
+                while ((last > 0) && (std::fabs(c[last]) <= tol * scale))
+                    --last;
+                c.resize(last + 1);
+                proxy.coeffs.swap(c);
+                return proxy;
+            }
+        }
+        throw MyError("Функция недостаточно гладкая для аппроксимации");
+    }
+    /**
+     * Значение аппроксимации в точке x.
+     */
+    double value(double x) const
+    {
+        return clenshaw(coeffs, toT(x));
+    }
+    /**
+     * Все локальные минимумы аппроксимации внутри (a;b): корни
+     * производной со сменой знака с минуса на плюс. Корни отделяются
+     * рекурсивным делением отрезка с пересчётом ряда производной на
+     * каждую часть (см. minimaIn), затем уточняются делением пополам.
+     */
+    std::vector<double> findMinima() const
+    {
+        std::vector<double> d = derivative(coeffs);
+        std::vector<double> result;
+        double scale = 0.0;
+        for (double dj : d) scale = std::max(scale, std::fabs(dj));
+        if (scale == 0.0)
+            return result;
+        minimaIn(d, d, -1.0, 1.0, 1e-13 * scale, result);
+        return result;
+    }
+    /**
+     * Построена ли аппроксимация (или построение прервано).
+     */
+    bool isBuilt() const { return !coeffs.empty(); }
+    /**
+     * Степень аппроксимирующего многочлена.
+     */
+    int getDegree() const { return coeffs.size() - 1; }
+    /**
+     * Кол-во вычислений функции при построении.
+     */
+    int getEvaluations() const { return evals; }
+};
+
+/**
+ * Параллельное выполнение независимых заданий.
+ */
+class Parallel
+{
+public:
+    /**
+     * Кол-во аппаратных потоков.
+     */
+    static int hardwareThreads()
+    {
+        return std::max(1u, std::thread::hardware_concurrency());
+    }
+    /**
+     * Вызов job(i) для i из [0;n) в threads потоках, включая текущий.
+     * Первое брошенное заданием исключение передаётся вызывающему.
+     */
+    static void forEach(size_t n, int threads,
+        const std::function<void(size_t)>& job)
+    {
+        std::atomic<size_t> next(0);
+        std::exception_ptr  error;
+        std::mutex          mtx;
+        auto worker = [&]() {
+            size_t i;
+            while ((i = next++) < n) {
+                try {
+                    job(i);
+                }
+                catch (...) {
+                    std::lock_guard<std::mutex> lock(mtx);
+                    if (!error) error = std::current_exception();
+                }
+            }
+        };
+        std::vector<std::thread> pool;
+        size_t count = std::min<size_t>(n, std::max(1, threads));
+        for (size_t t = 1; t < count; ++t)
+            pool.push_back(std::thread(worker));
+        worker();
+        for (auto& t : pool) t.join();
+        if (error)
+            std::rethrow_exception(error);
+    }
+};
+
+/**
+ * Постоянные потоки для многократного выполнения коротких заданий:
+ * потоки создаются один раз, а между вызовами forEach ждут работу,
+ * так что вызов не платит за создание потоков.
+ */
+class WorkerPool
+{
+    std::vector<std::thread>            workers;
+    std::mutex                          mtx;
+    std::condition_variable             wake;   // появилась работа или выход
+    std::condition_variable             idle;   // работа закончена
+    const std::function<void(size_t)>*  job;    // текущее задание
+    size_t                              count;  // кол-во его частей
+    size_t                              next;   // следующая часть
+    size_t                              running;// частей в работе
+    bool                                quit;   // завершение потоков
+    std::exception_ptr                  error;  // первое исключение задания
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    /**
+     * Выполнение частей задания, пока они есть (вызывается под mtx).
+     */
+    void drain(std::unique_lock<std::mutex>& lock)
+    {
+        while (next < count) {
+            size_t i = next++;
+            ++running;
+            lock.unlock();
+            try {
+                (*job)(i);
+            }
+            catch (...) {
+                lock.lock();
+                if (!error) error = std::current_exception();
+                lock.unlock();
+            }
+            lock.lock();
+            if ((--running == 0) && (next >= count))
+                idle.notify_all();
+        }
+    }
+    void loop()
+    {
+        std::unique_lock<std::mutex> lock(mtx);
+        while (true) {
+            wake.wait(lock, [this] { return quit || (next < count); });
+            if (quit) return;
+            drain(lock);
+        }
+    }
+
+public:
+
+    /**
+     * Пул на threads потоков, включая вызывающий.
+     */
+    explicit WorkerPool(int threads) :
+        workers(), mtx(), wake(), idle(), job(nullptr), count(0), next(0),
+        running(0), quit(false), error()
+    {
+        for (int t = 1; t < threads; ++t)
+            workers.push_back(std::thread(&WorkerPool::loop, this));
+    }
+    ~WorkerPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            quit = true;
+        }
+        wake.notify_all();
+        for (auto& t : workers) t.join();
+    }
+    /**
+     * Вызов fn(i) для i из [0;n) в потоках пула и в текущем.
+     * Первое брошенное исключение передаётся вызывающему.
+     */
+    void forEach(size_t n, const std::function<void(size_t)>& fn)
+    {
+        std::unique_lock<std::mutex> lock(mtx);
+        job = &fn;
+        count = n;
+        next = 0;
+        wake.notify_all();
+        drain(lock);
+        idle.wait(lock, [this] { return running == 0; });
+        job = nullptr;
+        count = next = 0;
+        if (error) {
+            std::exception_ptr e = error;
+            error = nullptr;
+            std::rethrow_exception(e);
+        }
+    }
+};
+
+/**
+ * Кэш вычисленных значений функции. Потокобезопасен; при смене
+ * функции очищается. Хранит не больше capacity значений: при
+ * переполнении вытесняются добавленные раньше всех.
+ */
+class EvalCache
+{
+    uint64_t                            owner;  // версия функции значений
+    std::unordered_map<double, double>  values; // x -> f(x)
+    std::vector<double>                 order;  // x по кругу в порядке добавления
+    size_t                              oldest; // место старейшего x в order
+    size_t                              capacity;   // предел кол-ва значений
+    mutable std::mutex                  mtx;
+    size_t                              hits;   // кол-во попаданий
+
+public:
+
+    explicit EvalCache(size_t cap = 1 << 16) :
+        owner(0), values(), order(), oldest(0), capacity(std::max<size_t>(1, cap)),
+        mtx(), hits(0)
+    {
+    }
+
+    /**
+     * Поиск значения fun в точке x.
+     */
+    bool find(const Function& fun, double x, double& y)
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (owner != fun.getVersion()) return false;
+        auto it = values.find(x);
+        if (it == values.end()) return false;
+        y = it->second;
+        ++hits;
+        return true;
+    }
+    /**
+     * Сохранение значения fun в точке x.
+     */
+    void store(const Function& fun, double x, double y)
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (owner != fun.getVersion()) {
+            values.clear();
+            order.clear();
+            oldest = 0;
+            owner = fun.getVersion();
+        }
+        auto it = values.find(x);
+        if (it != values.end()) {
+            it->second = y;
+            return;
+        }
+        if (order.size() < capacity) {
+            order.push_back(x);
+        }
+        else {
+            values.erase(order[oldest]);
+            order[oldest] = x;
+            oldest = (oldest + 1) % capacity;
+        }
+        values.emplace(x, y);
+    }
+    /**
+     * Кол-во попаданий в кэш.
+     */
+    size_t getHits() const
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        return hits;
+    }
+    /**
+     * Кол-во хранимых значений.
+     */
+    size_t getSize() const
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        return values.size();
+    }
+};
+
+/**
+ * Состояние золотого сечения: отрезок [a;b] и две внутренние точки.
+ */
+struct Golden
+{
+    static constexpr double RFI = 0.6180339887498948; // 2 / (1 + sqrt(5))
+
+    double a, b;
+    double x1, x2;
+    double y1, y2;
+
+    Golden(double l, double r) :
+        a(l), b(r),
+        x1(r - (r - l) * RFI), x2(l + (r - l) * RFI),
+        y1(0.0), y2(0.0)
+    {
+    }
+    /**
+     * Точка, которую нужно вычислить на следующем шаге.
+     */
+    double probe() const
+    {
+        return y1 >= y2 ? x1 + (b - x1) * RFI : x2 - (x2 - a) * RFI;
+    }
+    /**
+     * Шаг с известным значением y в точке probe().
+     */
+    void advance(double y)
+    {
+        if (y1 >= y2) {
+            a = x1;
+            x1 = x2;
+            y1 = y2;
+            x2 = a + (b - a) * RFI;
+            y2 = y;
+        }
+        else {
+            b = x2;
+            x2 = x1;
+            y2 = y1;
+            x1 = b - (b - a) * RFI;
+            y1 = y;
+        }
+    }
+};
+
+/**
+ * Решатель с обратной связью (reverse communication): сам функцию не
+ * вычисляет, а сообщает точку, в которой нужно значение, и продолжает
+ * работу, когда значение передадут. Так внешний код может собрать
+ * запросы многих решателей и вычислить их одним пакетом.
+ */
+class Stepper
+{
+protected:
+    double  pending;    // точка, в которой нужно значение
+    int     iterations; // кол-во сделанных шагов
+    int     limit;      // предел кол-ва шагов
+    bool    done;       // решение закончено
+    bool    failed;     // достигнут предел кол-ва шагов
+
+    Stepper(int lim) :
+        pending(0.0), iterations(0), limit(lim), done(false), failed(false)
+    {
+    }
+
+public:
+
+    virtual ~Stepper() {}
+
+    /**
+     * Решение закончено (успешно или нет).
+     */
+    bool isDone() const { return done; }
+    /**
+     * Закончилось ли решение пределом кол-ва шагов.
+     */
+    bool isFailed() const { return failed; }
+    /**
+     * Точка, в которой нужно значение функции.
+     */
+    double request() const { return pending; }
+    /**
+     * Продолжение с известным значением функции в точке request().
+     */
+    virtual void resume(double y) = 0;
+    /**
+     * Найденный минимум.
+     */
+    virtual double result() const = 0;
+    /**
+     * Текущий отрезок, содержащий минимум.
+     */
+    virtual Interval bracket() const = 0;
+    /**
+     * Кол-во сделанных шагов.
+     */
+    int getIterations() const { return iterations; }
+};
+
+/**
+ * Золотое сечение в виде решателя с обратной связью.
+ */
+class GoldenStepper : public Stepper
+{
+    Golden  g;      // текущий отрезок
+    double  eps;    // требуемая длина отрезка
+    int     phase;  // 0, 1 - вычисление начальных точек, 2 - основной цикл
+
+public:
+
+    GoldenStepper(double a, double b, double epsilon, int lim) :
+        Stepper(lim), g(a, b), eps(epsilon), phase(0)
+    {
+        pending = g.x1;
+    }
+    /**
+     * Продолжение с отрезка state, значения в точках которого известны.
+     */
+    GoldenStepper(const Golden& state, double epsilon, int lim) :
+        Stepper(lim), g(state), eps(epsilon), phase(2)
+    {
+        if (fabs(g.b - g.a) < eps)
+            done = true;
+        else
+            pending = g.probe();
+    }
+
+    virtual void resume(double y)
+    {
+        if (done) return;
+        if (phase == 0) {
+            g.y1 = y;
+            pending = g.x2;
+            phase = 1;
+            return;
+        }
+        if (phase == 1) {
+            g.y2 = y;
+            pending = g.probe();
+            phase = 2;
+            return;
+        }
+        ++iterations;
+        g.advance(y);
+        if (fabs(g.b - g.a) < eps)
+            done = true;
+        else if (iterations >= limit)
+            done = failed = true;
+        else
+            pending = g.probe();
+    }
+    virtual double result() const
+    {
+        return (g.a + g.b) / 2;
+    }
+    virtual Interval bracket() const
+    {
+        return Interval(g.a, g.b);
+    }
+    /**
+     * Известны ли значения в обеих точках отрезка (см. getState()).
+     */
+    bool hasState() const { return phase == 2; }
+    /**
+     * Текущий отрезок со значениями в точках.
+     */
+    const Golden& getState() const { return g; }
+};
+
+/**
+ * Метод Брента (параболическая интерполяция с подстраховкой золотым
+ * сечением) в виде решателя с обратной связью.
+ */
+class BrentStepper : public Stepper
+{
+    static constexpr double CGOLD = 0.3819660112501051; // 1 - 1/фи
+
+    double  a, b;           // текущий отрезок
+    double  x, w, v;        // лучшая, вторая и предыдущая вторая точки
+    double  fx, fw, fv;     // значения в них
+    double  d, e;           // последний и предпоследний шаги
+    double  eps;            // требуемая точность
+    bool    started;        // значение в начальной точке уже известно
+
+    /**
+     * Выбор следующей точки или завершение.
+     */
+    void plan()
+    {
+        double xm = (a + b) / 2;
+        double tol1 = 1.4901161193847656e-08 * fabs(x) + eps / 4;
+        double tol2 = 2 * tol1;
+        if (fabs(x - xm) <= tol2 - (b - a) / 2) {
+            done = true;
+            return;
+        }
+        if (++iterations > limit) {
+            done = failed = true;
+            return;
+        }
+        bool golden = true;
+        if (fabs(e) > tol1) {
+            double r = (x - w) * (fx - fv);
+            double q = (x - v) * (fx - fw);
+            double p = (x - v) * q - (x - w) * r;
+            q = 2 * (q - r);
+            if (q > 0) p = -p;
+            q = fabs(q);
+            double etemp = e;
+            e = d;
+            if (!((fabs(p) >= fabs(q * etemp / 2)) || (p <= q * (a - x))
+                || (p >= q * (b - x)))) {
+                d = p / q;
+                double u = x + d;
+                if ((u - a < tol2) || (b - u < tol2))
+                    d = xm - x >= 0 ? tol1 : -tol1;
+                golden = false;
+            }
+        }
+        if (golden) {
+            e = x >= xm ? a - x : b - x;
+            d = CGOLD * e;
+        }
+        pending = fabs(d) >= tol1 ? x + d : x + (d >= 0 ? tol1 : -tol1);
+    }
+
+public:
+
+    BrentStepper(double l, double r, double epsilon, int lim) :
+        Stepper(lim), a(l), b(r),
+        x(l + CGOLD * (r - l)), w(x), v(x),
+        fx(0.0), fw(0.0), fv(0.0),
+        d(0.0), e(0.0), eps(epsilon), started(false)
+    {
+        pending = x;
+    }
+    /**
+     * Начало с известной тройки: fm в точке m меньше значений fl, fr
+     * на краях отрезка [l;r], так что первый шаг - сразу парабола.
+     */
+    BrentStepper(double l, double fl, double m, double fm, double r, double fr,
+        double epsilon, int lim) :
+        Stepper(lim), a(l), b(r), x(m), w(l), v(r),
+        fx(fm), fw(fl), fv(fr),
+        d(0.0), e(r - l), eps(epsilon), started(true)
+    {
+        plan();
+    }
+
+    virtual void resume(double y)
+    {
+        if (done) return;
+        if (!started) {
+            fx = fw = fv = y;
+            started = true;
+            plan();
+            return;
+        }
+        double u = pending, fu = y;
+        if (fu <= fx) {
+            if (u >= x) a = x; else b = x;
+            v = w; fv = fw;
+            w = x; fw = fx;
+            x = u; fx = fu;
+        }
+        else {
+            if (u < x) a = u; else b = u;
+            if ((fu <= fw) || (w == x)) {
+                v = w; fv = fw;
+                w = u; fw = fu;
+            }
+            else if ((fu <= fv) || (v == x) || (v == w)) {
+                v = u; fv = fu;
+            }
+        }
+        plan();
+    }
+    virtual double result() const
+    {
+        return x;
+    }
+    virtual Interval bracket() const
+    {
+        return Interval(a, b);
+    }
+};
+
+/**
+ * Поиск Фибоначчи: золотое сечение на целочисленных индексах [from; to].
+ * Длина отрезка всегда равна числу Фибоначчи, поэтому одна из точек
+ * переходит в следующий шаг точно, без округлений. Отрезок из
+ * нескольких индексов в конце перебирается полностью. Индексы за
+ * последним допустимым вызывающий должен считать равными +inf.
+ */
+class FibonacciStepper : public Stepper
+{
+    uint64_t    a;          // левый край, правый - a + fib(k)
+    int         k;          // номер числа Фибоначчи длины отрезка
+    uint64_t    x1, x2;     // внутренние точки
+    double      y1, y2;     // значения в них
+    int         phase;      // 0, 1 - начальные точки, 2 - цикл, 3 - перебор
+    uint64_t    best;       // лучший индекс
+    double      bestY;      // значение в нём
+
+    /**
+     * Числа Фибоначчи (fib(93) уже не помещается в uint64_t).
+     */
+    static uint64_t fib(int n)
+    {
+        static const std::vector<uint64_t> table = [] {
+            std::vector<uint64_t> t(2, 1);
+            t[0] = 0;
+            while (t.size() < 93)
+                t.push_back(t[t.size() - 1] + t[t.size() - 2]);
+            return t;
+        }();
+        return table[n];
+    }
+    /**
+     * Запоминание лучшей точки.
+     */
+    void keep(uint64_t i, double y)
+    {
+        if (y < bestY) {
+            best = i;
+            bestY = y;
+        }
+    }
+    /**
+     * Точка, которую нужно вычислить на следующем шаге.
+     */
+    uint64_t probe() const
+    {
+        return y1 >= y2 ? x1 + fib(k - 2) : a + fib(k - 3);
+    }
+    /**
+     * Следующий запрос: новая точка или начало перебора.
+     */
+    void next()
+    {
+        if (k > 4) {
+            pending = double(probe());
+            phase = 2;
+        }
+        else {
+            pending = double(a);
+            phase = 3;
+        }
+    }
+
+public:
+
+    FibonacciStepper(uint64_t from, uint64_t to, int lim) :
+        Stepper(lim), a(from), k(1), x1(0), x2(0), y1(0.0), y2(0.0),
+        phase(0), best(from), bestY(HUGE_VAL)
+    {
+        while (fib(k) < to - from) ++k;
+        if (k > 4) {
+            x1 = a + fib(k - 2);
+            x2 = a + fib(k - 1);
+            pending = double(x1);
+        }
+        else {
+            pending = double(a);
+            phase = 3;
+        }
+    }
+
+    virtual void resume(double y)
+    {
+        if (done) return;
+        uint64_t at = uint64_t(pending);
+        keep(at, y);
+        if (phase == 0) {
+            y1 = y;
+            pending = double(x2);
+            phase = 1;
+            return;
+        }
+        if (phase == 1) {
+            y2 = y;
+            next();
+            return;
+        }
+        if (phase == 3) {
+            if (at >= a + fib(k))
+                done = true;
+            else
+                pending = double(at + 1);
+            return;
+        }
+        ++iterations;
+        if (y1 >= y2) {
+            a = x1;
+            x1 = x2;
+            y1 = y2;
+            x2 = at;
+            y2 = y;
+        }
+        else {
+            x2 = x1;
+            y2 = y1;
+            x1 = at;
+            y1 = y;
+        }
+        --k;
+        if (iterations >= limit)
+            done = failed = true;
+        else
+            next();
+    }
+    virtual double result() const
+    {
+        return double(best);
+    }
+    virtual Interval bracket() const
+    {
+        return Interval(double(a), double(a + fib(k)));
+    }
+};
+
+/**
+ * Пакетный прогон решателей с обратной связью: на каждом шаге точки,
+ * запрошенные всеми незаконченными решателями, вычисляются одним
+ * вызовом batch(ids, xs, ys, n), после чего решатели продолжают
+ * работу. В ids - номера решателей, запросивших точки xs.
+ */
+class StepperDriver
+{
+public:
+    using Batch = std::function<void(const size_t*, const double*, double*, size_t)>;
+
+    /**
+     * Прогон до завершения всех решателей. Возвращает кол-во пакетов.
+     */
+    static int run(const std::vector<Stepper*>& steppers, const Batch& batch)
+    {
+        std::vector<size_t> active;
+        std::vector<double> xs, ys;
+        int rounds = 0;
+        while (true) {
+            active.clear();
+            xs.clear();
+            for (size_t i = 0; i < steppers.size(); ++i) {
+                if (steppers[i]->isDone()) continue;
+                active.push_back(i);
+                xs.push_back(steppers[i]->request());
+            }
+            if (active.empty()) return rounds;
+            ys.resize(xs.size());
+            batch(active.data(), xs.data(), ys.data(), xs.size());
+            ++rounds;
+            for (size_t i = 0; i < active.size(); ++i)
+                steppers[active[i]]->resume(ys[i]);
+        }
+    }
+    /**
+     * Прогон с пакетным вычислением функции fun.
+     */
+    static int run(const std::vector<Stepper*>& steppers, const Function& fun)
+    {
+        return run(steppers,
+            [&fun](const size_t*, const double* xs, double* ys, size_t n) {
+                fun.calcValues(xs, ys, n);
+            });
+    }
+};
+
+/**
+ * Флаг отмены решения. Копии разделяют один флаг, поэтому отменить
+ * решение можно из другого потока.
+ */
+class CancelToken
+{
+    std::shared_ptr<std::atomic<bool>>  flag;
+    std::shared_ptr<const CancelToken>  parent; // его отмена отменяет и этот
+
+public:
+
+    CancelToken() : flag(std::make_shared<std::atomic<bool>>(false)), parent() {}
+
+    /**
+     * Новый флаг, который отменяется и вместе с этим.
+     */
+    CancelToken child() const
+    {
+        CancelToken t;
+        t.parent = std::make_shared<CancelToken>(*this);
+        return t;
+    }
+
+    void cancel() const { *flag = true; }
+    /**
+     * Снятие отмены, чтобы тем же флагом можно было отменить следующее
+     * решение.
+     */
+    void reset() const { *flag = false; }
+    bool isCancelled() const
+    {
+        return *flag || (parent && parent->isCancelled());
+    }
+};
+
+/**
+ * Счётчик, который можно увеличивать из нескольких потоков.
+ * При копировании копируется текущее значение.
+ */
+class Counter
+{
+    std::atomic<int> value;
+
+public:
+
+    Counter(int v = 0) : value(v) {}
+    Counter(const Counter& other) : value(other.value.load()) {}
+    Counter& operator=(const Counter& other)
+    {
+        value = other.value.load();
+        return *this;
+    }
+    Counter& operator+=(int n)
+    {
+        value += n;
+        return *this;
+    }
+    int get() const { return value; }
+};
+
+/**
+ * Статистика гонок методов: сколько раз какой метод первым решил
+ * задачу для каждой функции. Функция определяется номером в реестре,
+ * так что одноимённые функции не смешиваются, а новая версия
+ * функции сохраняет опыт прежней; функция без номера - версией
+ * объекта.
+ */
+class RaceStats
+{
+public:
+    typedef std::pair<int, uint64_t> Key;   // номер в реестре, версия
+
+private:
+    std::map<Key, std::vector<int>> wins;   // функция -> победы
+    mutable std::mutex              mtx;
+
+public:
+
+    static const int LEARN_RACES = 5; // гонок до выбора метода по опыту
+
+    /**
+     * Ключ функции fun с номером id в реестре (id < 0 - без номера).
+     */
+    static Key key(int id, const Function& fun)
+    {
+        return id >= 0 ? Key(id, 0) : Key(-1, fun.getVersion());
+    }
+    /**
+     * Учёт победы метода method (из count возможных) для функции.
+     */
+    void record(const Key& fun, int method, int count)
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        std::vector<int>& w = wins[fun];
+        w.resize(count, 0);
+        ++w[method];
+    }
+    /**
+     * Кол-во побед метода и всех гонок для функции.
+     */
+    void get(const Key& fun, int method, int& won, int& total) const
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        won = total = 0;
+        auto it = wins.find(fun);
+        if (it == wins.end()) return;
+        for (size_t m = 0; m < it->second.size(); ++m) {
+            total += it->second[m];
+            if ((int)m == method) won = it->second[m];
+        }
+    }
+    /**
+     * Метод, который обычно побеждает для функции, или -1, если опыта
+     * мало или явного победителя нет (меньше 3/4 побед).
+     */
+    int preferred(const Key& fun) const
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        auto it = wins.find(fun);
+        if (it == wins.end()) return -1;
+        const std::vector<int>& w = it->second;
+        int total = 0;
+        for (int n : w) total += n;
+        if (total < LEARN_RACES) return -1;
+        int best = std::max_element(w.begin(), w.end()) - w.begin();
+        return 4 * w[best] >= 3 * total ? best : -1;
+    }
+};
+
+/**
+ * Многочлен c[0] + c[1]*x + c[2]*x^2 + ...: распознавание в дереве
+ * выражения и вещественные корни на отрезке.
+ */
+class Polynomial
+{
+public:
+    typedef std::vector<double> Coeffs;
+
+    static const int MAX_DEGREE = 32;
+
+    /**
+     * Коэффициенты выражения e, если это многочлен от x степени не
+     * выше MAX_DEGREE: константы, x, +, -, *, деление на константу и
+     * неотрицательные целые степени. Иначе false.
+     */
+    static bool fromExpression(const Expression& e, Coeffs& c)
+    {
+        const Expression::Nodes& nodes = e.getNodes();
+        std::vector<Coeffs> poly(nodes.size());
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            const Expression::Node& n = nodes[i];
+            Coeffs& r = poly[i];
+            switch (n.op) {
+            case Expression::OP_CONST: r.assign(1, n.value); break;
+            case Expression::OP_X:     r = Coeffs{ 0.0, 1.0 }; break;
+            case Expression::OP_ADD:   r = add(poly[n.a], poly[n.b], 1.0); break;
+            case Expression::OP_SUB:   r = add(poly[n.a], poly[n.b], -1.0); break;
+            case Expression::OP_MUL:   r = multiply(poly[n.a], poly[n.b]); break;
+            case Expression::OP_NEG:   r = add(Coeffs(), poly[n.a], -1.0); break;
+            case Expression::OP_SQR:   r = multiply(poly[n.a], poly[n.a]); break;
+            case Expression::OP_DIV:
+                if (poly[n.b].size() != 1) return false;
+                r = add(Coeffs(), poly[n.a], 1.0 / poly[n.b][0]);
+                break;
+            case Expression::OP_POW: {
+                if (poly[n.b].size() != 1) return false;
+                double k = poly[n.b][0];
+                if ((k < 0) || (k > MAX_DEGREE) || (k != std::floor(k))) return false;
+                r.assign(1, 1.0);
+                for (int j = 0; j < int(k); ++j) {
+                    r = multiply(r, poly[n.a]);
+                    if (r.empty()) return false;
+                }
+                break;
+            }
+            default:
+                return false;
+            }
+            // пустой - не многочлен или слишком высокая степень
+            if (r.empty() || (int(r.size()) > MAX_DEGREE + 1)) return false;
+        }
+        c = poly.back();
+        trim(c);
+        return true;
+    }
+    /**
+     * Значение в точке x (схема Горнера).
+     */
+    static double eval(const Coeffs& c, double x)
+    {
+        double y = 0.0;
+        for (size_t i = c.size(); i-- > 0;)
+            y = y * x + c[i];
+        return y;
+    }
+    static Coeffs derivative(const Coeffs& c)
+    {
+        Coeffs d(c.size() > 1 ? c.size() - 1 : 1, 0.0);
+        for (size_t i = 1; i < c.size(); ++i)
+            d[i - 1] = c[i] * i;
+        return d;
+    }
+    static int degree(const Coeffs& c)
+    {
+        return int(c.size()) - 1;
+    }
+    /**
+     * Вещественные корни на [a;b] по возрастанию: до второй степени -
+     * по формулам, выше - отделение корней по теореме Ролля: между
+     * соседними корнями производной многочлен монотонен и имеет не
+     * больше одного корня, который находится делением пополам. Формула
+     * Кардано для третьей степени не используется: по знаку её
+     * дискриминанта близкие корни теряются.
+     */
+    static Coeffs roots(Coeffs c, double a, double b)
+    {
+        trim(c);
+        Coeffs r;
+        switch (degree(c)) {
+        case 0: break;
+        case 1: r.push_back(-c[0] / c[1]); break;
+        case 2: quadratic(c, r); break;
+        default: {
+            Coeffs ends = roots(derivative(c), a, b);
+            ends.insert(ends.begin(), a);
+            ends.push_back(b);
+            for (size_t i = 0; i + 1 < ends.size(); ++i)
+                bisect(c, ends[i], ends[i + 1], r);
+            break;
+        }
+        }
+        Coeffs inside;
+        for (double x : r)
+            if ((x >= a) && (x <= b)) inside.push_back(x + 0.0);  // без -0
+        std::sort(inside.begin(), inside.end());
+        inside.erase(std::unique(inside.begin(), inside.end()), inside.end());
+        return inside;
+    }
+
+private:
+
+    static void trim(Coeffs& c)
+    {
+        while ((c.size() > 1) && (c.back() == 0.0))
+            c.pop_back();
+    }
+    static Coeffs add(const Coeffs& a, const Coeffs& b, double k)
+    {
+        Coeffs r(std::max(a.size(), b.size()), 0.0);
+        for (size_t i = 0; i < a.size(); ++i) r[i] += a[i];
+        for (size_t i = 0; i < b.size(); ++i) r[i] += k * b[i];
+        return r;
+    }
+    /**
+     * Произведение (пустое, если степень больше MAX_DEGREE).
+     */
+    static Coeffs multiply(const Coeffs& a, const Coeffs& b)
+    {
+        if (int(a.size() + b.size()) - 2 > MAX_DEGREE)
+            return Coeffs();
+        Coeffs r(a.size() + b.size() - 1, 0.0);
+        for (size_t i = 0; i < a.size(); ++i)
+            for (size_t j = 0; j < b.size(); ++j)
+                r[i + j] += a[i] * b[j];
+        return r;
+    }
+    static void quadratic(const Coeffs& c, Coeffs& r)
+    {
+        double disc = c[1] * c[1] - 4 * c[2] * c[0];
+        if (disc < 0) return;
+        // без вычитания близких чисел
+        double q = -0.5 * (c[1] + (c[1] < 0 ? -1 : 1) * std::sqrt(disc));
+        if (q == 0) {
+            r.push_back(0.0);
+            return;
+        }
+        r.push_back(q / c[2]);
+        r.push_back(c[0] / q);
+    }
+    /**
+     * Корень монотонного на [a;b] многочлена, если он там есть.
+     */
+    static void bisect(const Coeffs& c, double a, double b, Coeffs& r)
+    {
+        double fa = eval(c, a), fb = eval(c, b);
+        if (fa == 0) { r.push_back(a); return; }
+        if (fb == 0) { r.push_back(b); return; }
+        if ((fa < 0) == (fb < 0)) return;
+        while (true) {
+            double m = a + (b - a) / 2;
+            if ((m <= a) || (m >= b)) break;
+            double fm = eval(c, m);
+            if (fm == 0) { a = b = m; break; }
+            if ((fm < 0) == (fa < 0)) a = m; else b = m;
+        }
+        r.push_back(a + (b - a) / 2);
+    }
+};
+
+/**
+ * Данные для решения задачи.
+ */
+class Problem
+{
+    int         iterations; // кол-во итераций
+    int         precision;  // точность (знаков).
+    double      epsilon;    // точность вычислений (epsilon).
+    double      left;       // левый конец отрезка, содержащего минимум
+    double      right;      // правый конец отрезка, содержащего минимум
+    long double      x;          // найденный минимум
+    int         method;     // метод поиска
+    Interval    argRange;   // гарантированный отрезок, содержащий минимум
+    Interval    minRange;   // гарантированные границы значения минимума
+    std::vector<double> minima; // все найденные локальные минимумы
+    int         threads;    // кол-во потоков для параллельных методов
+    bool        speculative;// упреждающее вычисление следующих точек
+    double      elapsed;    // время последнего решения, мс
+    std::shared_ptr<EvalCache>  cache;  // кэш значений функции (может не быть)
+    int         maxEvaluations; // предел вычислений функции (0 - нет)
+    double      maxTime;    // предел времени решения, мс (0 - нет)
+    CancelToken token;      // флаг отмены решения
+    Counter     evaluations;// кол-во вычислений функции
+    std::chrono::steady_clock::time_point started; // начало решения
+    const char* stopReason; // почему решение остановлено досрочно (или 0)
+    int         winner;     // метод, победивший в гонке (или -1)
+    int         chosen;     // метод, выбранный автоматически (или -1)
+    std::string decision;   // обоснование автоматического выбора
+    int         probes;     // вычислений функции на пробы для выбора
+    std::shared_ptr<RaceStats>  stats;  // статистика гонок методов
+    int         functionId; // номер функции в реестре (или -1)
+    Golden      retained;   // последний отрезок золотого сечения
+    uint64_t    retainedFun;    // для какой версии функции он получен (или 0)
+    bool        resumed;    // решение продолжило прошлое
+    std::string xText;      // минимум повышенной точности (или пусто)
+    int         stages[3];  // итераций поэтапного поиска по этапам
+    int         degree;     // степень многочлена при решении по формулам (или 0)
+    bool        closedForm; // многочлены решаются по формулам
+    int         resolved;   // различимо знаков, если меньше precision (или -1)
+
+public:
+
+    static const int ITERATION_LIMIT = 10000; // предел кол-ва итераций
+
+    /**
+     * Методы поиска минимума.
+     */
+    enum {
+        METHOD_GOLDEN,      // золотое сечение
+        METHOD_INTERVAL,    // ветви и границы на интервальной арифметике
+        METHOD_CHEBYSHEV,   // все минимумы по чебышёвской аппроксимации
+        METHOD_KSECTION,    // параллельное k-деление
+        METHOD_BRENT,       // метод Брента
+        METHOD_NEWTON,      // метод Ньютона с подстраховкой делением пополам
+        METHOD_PORTFOLIO,   // гонка нескольких методов
+        METHOD_AUTO,        // выбор метода по пробным значениям
+        METHOD_STAGED,      // float -> double -> расширенная точность
+
+        METHOD_COUNT
+    };
+
+    Problem() :
+        iterations(0),
+        precision(5),
+        epsilon(pow(10, -precision)),
+        left(-1.0),
+        right(1.0),
+        x(0.0),
+        method(METHOD_GOLDEN),
+        argRange(),
+        minRange(),
+        minima(),
+        threads(Parallel::hardwareThreads()),
+        speculative(false),
+        elapsed(0.0),
+        cache(),
+        maxEvaluations(0),
+        maxTime(0.0),
+        token(),
+        evaluations(),
+        started(),
+        stopReason(nullptr),
+        winner(-1),
+        chosen(-1),
+        decision(),
+        probes(0),
+        stats(std::make_shared<RaceStats>()),
+        functionId(-1),
+        retained(0.0, 0.0),
+        retainedFun(0),
+        resumed(false),
+        xText(),
+        stages(),
+        degree(0),
+        closedForm(true),
+        resolved(-1)
+    {
+    }
+
+    /**
+     * Название метода по коду.
+     */
+    static const char* getMethodName(int m)
+    {
+        switch (m) {
+        case METHOD_GOLDEN:     return "золотое сечение";
+        case METHOD_INTERVAL:   return "гарантированный (интервальный)";
+        case METHOD_CHEBYSHEV:  return "все минимумы (аппроксимация Чебышёва)";
+        case METHOD_KSECTION:   return "параллельное k-деление";
+        case METHOD_BRENT:      return "метод Брента";
+        case METHOD_NEWTON:     return "метод Ньютона";
+        case METHOD_PORTFOLIO:  return "гонка методов";
+        case METHOD_AUTO:       return "автоматический выбор";
+        case METHOD_STAGED:     return "поэтапный (float, double, расширенная)";
+        default:                return "?";
+        }
+    }
+
+private:
+
+    /**
+     * Значение функции с учётом кэша.
+     */
+    double evaluate(const Function& fun, double at)
+    {
+        double y;
+        if (cache && cache->find(fun, at, y))
+            return y;
+        y = fun.calcValue(at);
+        evaluations += 1;
+        if (cache)
+            cache->store(fun, at, y);
+        return y;
+    }
+    /**
+     * Значения функции в n точках одним пакетом, с учётом кэша.
+     */
+    void evaluateMany(const Function& fun, const double* xs, double* ys, size_t n)
+    {
+        std::vector<double> miss, got;
+        std::vector<size_t> where;
+        for (size_t i = 0; i < n; ++i) {
+            if (cache && cache->find(fun, xs[i], ys[i]))
+                continue;
+            miss.push_back(xs[i]);
+            where.push_back(i);
+        }
+        if (miss.empty())
+            return;
+        got.resize(miss.size());
+        fun.calcValues(miss.data(), got.data(), miss.size());
+        evaluations += miss.size();
+        for (size_t j = 0; j < miss.size(); ++j) {
+            ys[where[j]] = got[j];
+            if (cache)
+                cache->store(fun, miss[j], got[j]);
+        }
+    }
+    /**
+     * Сохранение отрезка золотого сечения для продолжения решения при
+     * повышении точности или расширении границ.
+     */
+    void retain(const Function& fun, const Golden& g)
+    {
+        retained = g;
+        retainedFun = fun.getVersion();
+    }
+    /**
+     * Исчерпаны ли ограничения решения; возвращает причину или 0.
+     */
+    const char* budgetExceeded() const
+    {
+        if (token.isCancelled())
+            return "отменено";
+        if ((maxEvaluations > 0) && (evaluations.get() >= maxEvaluations))
+            return "исчерпан предел вычислений функции";
+        if ((maxTime > 0) && (std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - started).count() >= maxTime))
+            return "исчерпан предел времени";
+        return nullptr;
+    }
+    /**
+     * Прогон решателя с обратной связью: значения функции передаются
+     * ему через evaluate(). Возвращает причину остановки по
+     * ограничениям или 0, если решатель закончил работу.
+     */
+    const char* drive(Stepper& st, const Function& fun)
+    {
+        while (!st.isDone()) {
+            if (const char* reason = budgetExceeded())
+                return reason;
+            st.resume(evaluate(fun, st.request()));
+        }
+        return nullptr;
+    }
+    /**
+     * Досрочная остановка с лучшим найденным отрезком [a;b].
+     */
+    void stop(const char* reason, double a, double b)
+    {
+        stopReason = reason;
+        argRange = Interval(a, b);
+        x = (a + b) / 2;
+    }
+    /**
+     * Точность для численной производной: epsilon, но не мельче, чем
+     * различимо в double (иначе при повышенной точности x + dx == x).
+     */
+    double derivationStep() const
+    {
+        return std::max(epsilon, 1e-6);
+    }
+    /**
+     * Значение производной функции f в точке at. Вычисления функции
+     * для неё учитываются в evaluations.
+     */
+    double dfdx(const Function& f, double at)
+    {
+        double d[3];
+        if (f.calcDerivatives(at, d)) {
+            evaluations += 1;
+            return d[1];
+        }
+        evaluations += 2;
+        return f.calcDerivation(at, derivationStep());
+    }
+    /**
+     * Имеет ли функция минимум  на отрезке [left;right].
+     */
+    bool hasMinimum(const Function& f)
+    {
+        return (dfdx(f, left) < 0) && (dfdx(f, right) > 0);
+    }
+
+public:
+
+    double getLeft() const { return left; }
+    double getRight() const { return right; }
+    int getPrecision() const { return precision; }
+    double getEpsilon() const { return epsilon; }
+    int getIterations() const { return iterations; }
+    int getMethod() const { return method; }
+    int getThreads() const { return threads; }
+    bool isSpeculative() const { return speculative; }
+    const RaceStats& getRaceStats() const { return *stats; }
+    int getMaxEvaluations() const { return maxEvaluations; }
+    double getMaxTime() const { return maxTime; }
+    int getEvaluations() const { return evaluations.get(); }
+    bool isStopped() const { return stopReason != nullptr; }
+    const CancelToken& getCancelToken() const { return token; }
+    double getElapsed() const { return elapsed; }
+    double getX() const { return x; }
+    /**
+     * Установка границ отрезка.
+     */
+    void setBounds(double a, double b)
+    {
+        left = a < b ? a : b;
+        right = a < b ? b : a;
+    }
+    /**
+     * Установка кол-ва потоков.
+     */
+    void setThreads(int n)
+    {
+        if (n < 1)
+            throw MyError("Кол-во потоков должно быть положительным");
+        threads = n;
+    }
+    /**
+     * Включение упреждающих вычислений в золотом сечении. Имеет смысл
+     * только для дорогих функций: для дешёвых накладные расходы на
+     * потоки больше выигрыша.
+     */
+    void setSpeculative(bool on)
+    {
+        speculative = on;
+        if (on && !cache)
+            cache = std::make_shared<EvalCache>();
+    }
+    /**
+     * Решение многочленов по формулам (через корни производной) вместо
+     * итераций; выключается, например, для замеров самих методов.
+     */
+    void setClosedForm(bool on)
+    {
+        closedForm = on;
+    }
+    /**
+     * Ограничения решения: предел вычислений функции и времени в мс
+     * (0 - без ограничения). Когда ограничение исчерпано, решение
+     * останавливается с лучшим найденным отрезком, а не с ошибкой.
+     */
+    void setBudget(int evals, double ms)
+    {
+        if ((evals < 0) || (ms < 0))
+            throw MyError("Ограничения не могут быть отрицательными");
+        maxEvaluations = evals;
+        maxTime = ms;
+    }
+    /**
+     * Установка флага отмены (общего с другими решателями).
+     */
+    void setCancelToken(const CancelToken& t)
+    {
+        token = t;
+    }
+    /**
+     * Номер решаемой функции в реестре (-1 - нет): по нему ведётся
+     * статистика гонок методов.
+     */
+    void setFunctionId(int id)
+    {
+        functionId = id;
+    }
+    /**
+     * Выбор метода поиска.
+     */
+    void setMethod(int m)
+    {
+        if ((m < 0) || (m >= METHOD_COUNT))
+            throw MyError("Неверный метод");
+        method = m;
+    }
+    /**
+     * Установка точности.
+     */
+    void setPrecision(int prec)
+    {
+        precision = prec;
+        epsilon = pow(10, -precision);
+    }
+    /**
+     * Строка с отрезком.
+     */
+    std::string getBoundsString() const
+    {
+        std::ostringstream oss;
+        oss << std::fixed << std::setprecision(precision)
+            << '[' << left << ';' << right << ']';
+        return oss.str();
+    }
+    /**
+     * Строка с точностью.
+     */
+    std::string getPrecisionString() const
+    {
+        std::ostringstream oss;
+        oss << precision << " знаков после запятой ("
+            << std::fixed << std::setprecision(precision)
+            << epsilon << ")";
+        return oss.str();
+    }
+    /**
+     * Строка с решением.
+     */
+    std::string getSolutionString() const
+    {
+        std::ostringstream oss;
+        int used = chosen >= 0 ? chosen : method;
+        if (used == METHOD_INTERVAL) {
+            oss << std::setprecision(precision + 2)
+                << "Минимум: " << x << " на [" << argRange.lo << ';'
+                << argRange.hi << "], значение в [" << minRange.lo << ';'
+                << minRange.hi << "] (проверено " << iterations
+                << " отрезков)";
+        }
+        else if (used == METHOD_CHEBYSHEV) {
+            oss << std::setprecision(precision + 2) << "Минимумы:";
+            for (double m : minima) oss << ' ' << m;
+            oss << "; наименьший: " << x << " (" << iterations
+                << " вычислений функции)";
+        }
+        else {
+            oss << "Минимум: ";
+            if (xText.empty())
+                oss << x;
+            else
+                oss << xText;
+            if (degree > 0)
+                oss << " (найден по формулам: многочлен степени " << degree;
+            else
+                oss << " (найден за " << iterations << " итераций";
+            if (used == METHOD_STAGED) {
+                oss << ": float " << stages[0] << ", double " << stages[1]
+                    << ", расширенная " << stages[2];
+            }
+            if (resolved >= 0)
+                oss << ", по значениям функции различимо знаков: " << resolved;
+            oss
+                << (resumed ? ", продолжение прошлого решения" : "") << ")";
+        }
+        if (winner >= 0) {
+            oss << "; первым решил: " << getMethodName(winner);
+        }
+        if (stopReason) {
+            oss << std::setprecision(precision + 2) << "; остановлено: "
+                << stopReason << ", минимум на [" << argRange.lo << ';'
+                << argRange.hi << ']';
+        }
+        return oss.str();
+    }
+    /**
+     * Строка с показателями последнего решения.
+     */
+    std::string getMetricsString() const
+    {
+        std::ostringstream oss;
+        oss << "Время решения: " << elapsed << " мс, вычислений функции: "
+            << evaluations.get();
+        if (chosen >= 0) {
+            oss << "; выбран метод: " << getMethodName(chosen) << " ("
+                << decision << "), проб: " << probes;
+        }
+        return oss.str();
+    }
+    /**
+     * Результат одной задачи серии.
+     */
+    struct SweepPoint
+    {
+        double  param;          // значение параметра
+        double  x;              // найденный минимум (NaN - не найден)
+        int     evaluations;    // кол-во вычислений функции
+        bool    warm;           // решена из узкого отрезка около соседа
+    };
+    /**
+     * Задачи серии при count значениях параметра из [p0;p1] по
+     * возрастанию параметра, ещё не решённые.
+     */
+    static std::vector<SweepPoint> sweepPoints(double p0, double p1, int count)
+    {
+        if (count < 1)
+            throw MyError("Кол-во значений параметра должно быть положительным");
+        std::vector<SweepPoint> points(count);
+        for (int i = 0; i < count; ++i) {
+            points[i].param = count > 1 ? p0 + (p1 - p0) * i / (count - 1) : p0;
+            points[i].x = std::numeric_limits<double>::quiet_NaN();
+            points[i].evaluations = 0;
+            points[i].warm = false;
+        }
+        std::sort(points.begin(), points.end(),
+            [](const SweepPoint& l, const SweepPoint& r) { return l.param < r.param; });
+        return points;
+    }
+    /**
+     * Серия задач для семейства fam при count значениях параметра из
+     * [p0;p1]. Соседние значения решаются подряд: каждая задача
+     * начинается с узкого отрезка около минимума предыдущей, и отрезок
+     * расширяется, только если минимум в нём не окружён. Цепочки
+     * соседних значений распределяются по потокам.
+     */
+    std::vector<SweepPoint> sweep(const ParametricFunction& fam,
+        double p0, double p1, int count) const
+    {
+        std::vector<SweepPoint> points = sweepPoints(p0, p1, count);
+        int chains = std::min(threads, count);
+        Parallel::forEach(chains, chains, [&](size_t c) {
+            Problem sub(*this);
+            sub.cache.reset();
+            double prev = std::numeric_limits<double>::quiet_NaN();
+            double step = 0.0;
+            for (size_t i = count * c / chains; i < count * (c + 1) / chains; ++i) {
+                BoundFunction fun(fam, points[i].param);
+                sub.evaluations = Counter();
+                sub.started = std::chrono::steady_clock::now();
+                double found = sub.warmSolve(fun, prev, step, points[i].warm);
+                points[i].x = found;
+                points[i].evaluations = sub.evaluations.get();
+                if ((found == found) && (prev == prev))
+                    step = fabs(found - prev);
+                prev = found;
+            }
+        });
+        return points;
+    }
+    /**
+     * Серия задач без прогрева: все count задач решаются золотым
+     * сечением на [left;right] одновременно, и на каждом шаге точки
+     * всех незаконченных решателей вычисляются одним пакетом (см.
+     * StepperDriver). Задачи, у которых минимум на отрезке не окружён,
+     * не решаются.
+     */
+    std::vector<SweepPoint> sweepBatch(const ParametricFunction& fam,
+        double p0, double p1, int count) const
+    {
+        std::vector<SweepPoint> points = sweepPoints(p0, p1, count);
+        // наклоны на концах, как в hasMinimum(), для всех задач сразу
+        const double dx = derivationStep() / 10.0;
+        const double ends[4] = { left, left + dx, right, right + dx };
+        std::vector<double> xs(4 * count), ps(4 * count), ys(4 * count);
+        for (int i = 0; i < count; ++i) {
+            for (int k = 0; k < 4; ++k) {
+                xs[4 * i + k] = ends[k];
+                ps[4 * i + k] = points[i].param;
+            }
+        }
+        fam.calcValues(xs.data(), ps.data(), ys.data(), xs.size());
+        std::vector<GoldenStepper> steppers;
+        std::vector<size_t> owner;  // задача каждого решателя
+        steppers.reserve(count);
+        for (int i = 0; i < count; ++i) {
+            points[i].evaluations = 4;
+            if ((ys[4 * i + 1] < ys[4 * i]) && (ys[4 * i + 3] > ys[4 * i + 2])) {
+                steppers.push_back(GoldenStepper(left, right, epsilon, ITERATION_LIMIT));
+                owner.push_back(i);
+            }
+        }
+        std::vector<Stepper*> active;
+        for (auto& st : steppers) active.push_back(&st);
+        StepperDriver::run(active,
+            [&](const size_t* ids, const double* bx, double* by, size_t n) {
+                ps.resize(n);
+                for (size_t j = 0; j < n; ++j) {
+                    SweepPoint& pt = points[owner[ids[j]]];
+                    ps[j] = pt.param;
+                    ++pt.evaluations;
+                }
+                fam.calcValues(bx, ps.data(), by, n);
+            });
+        for (size_t j = 0; j < steppers.size(); ++j) {
+            if (!steppers[j].isFailed())
+                points[owner[j]].x = steppers[j].result();
+        }
+        return points;
+    }
+    /**
+     * Поиск минимума выбранным методом. Отмена относится к текущему
+     * решению: в начале флаг отмены снимается.
+     */
+    void solve(const Function& fun)
+    {
+        token.reset();
+        run(fun);
+    }
+
+private:
+
+    /**
+     * Решение без снятия флага отмены (для участников гонки с общим
+     * флагом).
+     */
+    void run(const Function& fun)
+    {
+        started = std::chrono::steady_clock::now();
+        evaluations = Counter();
+        stopReason = nullptr;
+        winner = -1;
+        chosen = -1;
+        probes = 0;
+        resumed = false;
+        xText.clear();
+        degree = 0;
+        resolved = -1;
+        solveWith(fun);
+        elapsed = std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - started).count();
+    }
+
+    void solveWith(const Function& fun)
+    {
+        if (((method == METHOD_GOLDEN) || (method == METHOD_AUTO))
+            && closedForm && (precision <= Real<double>::digits())
+            && findMinimumPolynomial(fun))
+            return;
+        switch (method) {
+        case METHOD_INTERVAL:   findGlobalMinimum(fun); break;
+        case METHOD_CHEBYSHEV:  findAllMinima(fun); break;
+        case METHOD_KSECTION:   findMinimumParallel(fun); break;
+        case METHOD_BRENT:      findMinimumBrent(fun); break;
+        case METHOD_NEWTON:     findMinimumNewton(fun); break;
+        case METHOD_PORTFOLIO:  findMinimumPortfolio(fun); break;
+        case METHOD_AUTO:       findMinimumAuto(fun); break;
+        case METHOD_STAGED:     findMinimumStaged(fun); break;
+        default:
+            if (precision > Real<double>::digits())
+                findMinimumExtended(fun);
+            else if (speculative)
+                findMinimumSpeculative(fun);
+            else
+                findMinimum(fun);
+            break;
+        }
+    }
+
+public:
+
+    /**
+     * Поиск минимума.
+     * Бросает исключения при всяких ошибках.
+     */
+    void findMinimum(const Function& fun)
+    {
+        iterations = 0;
+        resumed = (retainedFun == fun.getVersion()) && (left <= retained.a)
+            && (retained.b <= right);
+        retainedFun = 0;
+        if (!resumed && !hasMinimum(fun))
+            throw MyError("Похоже, нет минимума на заданном отрезке!");
+        // прошлый отрезок лежит внутри нового: продолжаем с него
+        GoldenStepper st = resumed
+            ? GoldenStepper(retained, epsilon, ITERATION_LIMIT)
+            : GoldenStepper(left, right, epsilon, ITERATION_LIMIT);
+        const char* reason = drive(st, fun);
+        iterations = st.getIterations();
+        if (st.isFailed())
+            throw MyError("Достигнут предел кол-ва итераций!");
+        if (st.hasState())
+            retain(fun, st.getState());
+        x = st.result();
+        if (reason)
+            stop(reason, st.bracket().lo, st.bracket().hi);
+    }
+    /**
+     * Золотое сечение на [from;to] в арифметике типа T (DoubleDouble,
+     * Quad) для точности больше, чем даёт double. Отрезок сужается до
+     * 10^-precision, но не уже нескольких единиц младшего разряда T
+     * относительно |x|. Печатаются только знаки, различимые по
+     * значениям функции (см. resolvedDigits()).
+     */
+    template< class T > void findMinimumIn(const Function& fun,
+        double from, double to)
+    {
+        typedef Real<T> R;
+        T eps = R::fromDouble(1.0);
+        for (int i = 0; i < precision; ++i) eps = eps / R::fromDouble(10.0);
+        T a = R::fromDouble(from);
+        T b = R::fromDouble(to);
+        T rfi = R::fromDouble(2.0)
+            / (R::fromDouble(1.0) + sqrtT(R::fromDouble(5.0)));
+        T x1 = b - (b - a) * rfi;
+        T x2 = a + (b - a) * rfi;
+        T y1 = fun.calcValue(x1);
+        T y2 = fun.calcValue(x2);
+        evaluations += 2;
+        iterations = 0;
+        while (iterations < ITERATION_LIMIT) {
+            ++iterations;
+            if (y1 >= y2) {
+                a = x1;
+                x1 = x2;
+                y1 = y2;
+                x2 = a + (b - a) * rfi;
+                y2 = fun.calcValue(x2);
+            }
+            else {
+                b = x2;
+                x2 = x1;
+                y2 = y1;
+                x1 = b - (b - a) * rfi;
+                y1 = fun.calcValue(x1);
+            }
+            evaluations += 1;
+            T mid = (a + b) / R::fromDouble(2.0);
+            T ulp = R::eps() * R::fromDouble(4.0 * std::max(1.0, std::fabs(R::toDouble(mid))));
+            if ((b - a < eps) || (b - a < ulp))
+            {
+                x = R::toDouble(mid);
+                int digits = resolvedDigits<T>(fun, mid);
+                if (digits < precision)
+                    resolved = digits;
+                xText = R::toString(mid, std::min(precision, digits));
+                return;
+            }
+            if (const char* reason = budgetExceeded()) {
+                stop(reason, R::toDouble(a), R::toDouble(b));
+                xText = R::toString(mid, precision);
+                return;
+            }
+        }
+        throw MyError("Достигнут предел кол-ва итераций!");
+    }
+    /**
+     * Сколько знаков после запятой минимума mid различимы по значениям
+     * функции в арифметике T. Около минимума f(x) ~ f(m) + c (x - m)^2
+     * / 2, и при погрешности значений sigma сравнения перестают
+     * различать точки ближе sqrt(2 sigma / c). Кривизна c оценивается
+     * второй разностью с шагом, при котором она заметно больше sigma.
+     * Заодно учитывается младший разряд самого x.
+     */
+    template< class T > int resolvedDigits(const Function& fun, const T& mid)
+    {
+        typedef Real<T> R;
+        const T zero = R::fromDouble(0.0);
+        T ym = fun.calcValue(mid);
+        double sigma = 4 * R::toDouble(R::eps())
+            * std::max(std::fabs(R::toDouble(ym)), std::numeric_limits<double>::min());
+        double h = std::sqrt(std::sqrt(sigma)) * std::max(1.0, std::fabs(R::toDouble(mid)));
+        T step = R::fromDouble(h);
+        T yl = fun.calcValue(mid - step);
+        T yr = fun.calcValue(mid + step);
+        evaluations += 3;
+        T second = yl + yr - ym - ym;
+        double c = R::toDouble(second < zero ? -second : second) / (h * h);
+        double r = c > 0 ? 2 * std::sqrt(sigma / c) : h;
+        r = std::max(r, 4 * R::toDouble(R::eps())
+            * std::max(1.0, std::fabs(R::toDouble(mid))));
+        return std::max(0, int(std::floor(-std::log10(r))));
+    }
+    /**
+     * Выбор типа повышенной точности по требуемой точности. Функции,
+     * которые считают только в double, не дают больше знаков, и такая
+     * точность для них не принимается.
+     */
+    void findMinimumExtended(const Function& fun, double from, double to)
+    {
+        requireExtended(fun);
+        if (precision <= Real<DoubleDouble>::digits()) {
+            findMinimumIn<DoubleDouble>(fun, from, to);
+            return;
+        }
+#ifdef HAVE_FLOAT128
+        if (precision <= Real<Quad>::digits()) {
+            findMinimumIn<Quad>(fun, from, to);
+            return;
+        }
+#endif
+        throw MyError("Такая точность не поддерживается");
+    }
+    void requireExtended(const Function& fun) const
+    {
+        if ((precision > Real<double>::digits()) && !fun.hasExtendedPrecision())
+            throw MyError("Функция считается только в double: больше 15 знаков не различить");
+    }
+    void findMinimumExtended(const Function& fun)
+    {
+        requireExtended(fun);
+        if (!hasMinimum(fun))
+            throw MyError("Похоже, нет минимума на заданном отрезке!");
+        findMinimumExtended(fun, left, right);
+    }
+    /**
+     * Поэтапный поиск: грубая локализация по 16 точкам за раз в float
+     * (выражения считаются блоками по командам, sin и cos - через
+     * LaneMath; сравнение с double - --bench-staged), уточнение золотым
+     * сечением в double и, если нужна точность больше double, - в
+     * расширенной точности. Каждый этап передаёт следующему свой
+     * отрезок с запасом, чтобы ошибки округления грубого этапа не
+     * потеряли минимум.
+     */
+    void findMinimumStaged(const Function& fun)
+    {
+        requireExtended(fun);
+        if (!hasMinimum(fun))
+            throw MyError("Похоже, нет минимума на заданном отрезке!");
+        const int LANES = 16;
+        double a = left;
+        double b = right;
+        // этап 1: float, 16 точек за раз, отрезок сужается в 8.5 раз
+        float xs[LANES], ys[LANES];
+        int coarse = 0;
+        while (coarse < ITERATION_LIMIT) {
+            double mid = fabs(a + b) / 2;
+            if ((b - a < epsilon) || (b - a < 1e-3 * (1 + mid)))
+                break;
+            ++coarse;
+            double step = (b - a) / (LANES + 1);
+            for (int i = 0; i < LANES; ++i) xs[i] = float(a + step * (i + 1));
+            fun.calcValues(xs, ys, LANES);
+            evaluations += LANES;
+            int best = 0;
+            for (int i = 1; i < LANES; ++i) {
+                if (ys[i] < ys[best]) best = i;
+            }
+            // значения в пределах погрешности float от лучшего: какая
+            // точка на самом деле лучше, неизвестно - дальше в double
+            float noise = 16 * std::numeric_limits<float>::epsilon() * std::fabs(ys[best]);
+            bool tied = false;
+            for (int i = 0; i < LANES; ++i) {
+                if ((i != best) && !(ys[i] - ys[best] > noise)) tied = true;
+            }
+            if (tied)
+                break;
+            double na = a + step * best;
+            double nb = a + step * (best + 2);
+            a = na;
+            b = nb;
+        }
+        // запас в пол-отрезка с каждой стороны
+        double margin = (b - a) / 2;
+        a = std::max(left, a - margin);
+        b = std::min(right, b + margin);
+        // этап 2: double, до точности, различимой по значениям в double
+        double tol = precision > Real<double>::digits()
+            ? std::max(epsilon, 1e-7 * (1 + fabs(a + b) / 2)) : epsilon;
+        GoldenStepper st(a, b, tol, ITERATION_LIMIT);
+        if (const char* reason = drive(st, fun)) {
+            iterations = coarse + st.getIterations();
+            stop(reason, st.bracket().lo, st.bracket().hi);
+            x = st.result();
+            return;
+        }
+        if (st.isFailed())
+            throw MyError("Достигнут предел кол-ва итераций!");
+        stages[0] = coarse;
+        stages[1] = st.getIterations();
+        stages[2] = 0;
+        if (precision <= Real<double>::digits()) {
+            iterations = coarse + stages[1];
+            x = st.result();
+            return;
+        }
+        // этап 3: расширенная точность
+        Interval br = st.bracket();
+        margin = br.width();
+        findMinimumExtended(fun, std::max(left, br.lo - margin),
+            std::min(right, br.hi + margin));
+        stages[2] = iterations;
+        iterations = coarse + stages[1] + stages[2];
+    }
+    /**
+     * Поиск минимума методом Ньютона для уравнения f'(x) = 0. Если шаг
+     * Ньютона выходит за отрезок, где f' меняет знак, или f'' <= 0,
+     * делается шаг деления пополам. Производные точные, если функция
+     * их считает (одно вычисление на шаг), иначе разностные.
+     */
+    void findMinimumNewton(const Function& fun)
+    {
+        if (!hasMinimum(fun))
+            throw MyError("Похоже, нет минимума на заданном отрезке!");
+        double a = left;
+        double b = right;
+        double xk = (a + b) / 2;
+        iterations = 0;
+        while (iterations < ITERATION_LIMIT) {
+            ++iterations;
+            double d[3];
+            double d1, d2;
+            if (fun.calcDerivatives(xk, d)) {
+                evaluations += 1;
+                d1 = d[1];
+                d2 = d[2];
+            }
+            else {
+                // центральные разности с шагами порядка eps^(1/3) и eps^(1/4)
+                double h1 = 6e-6 * (1 + fabs(xk));
+                double h2 = 1e-4 * (1 + fabs(xk));
+                double y0 = evaluate(fun, xk);
+                d1 = (evaluate(fun, xk + h1) - evaluate(fun, xk - h1)) / (2 * h1);
+                d2 = (evaluate(fun, xk + h2) - 2 * y0
+                    + evaluate(fun, xk - h2)) / (h2 * h2);
+            }
+            if ((d1 == 0) && (d2 > 0)) {
+                // точная производная обратилась в ноль
+                x = xk;
+                return;
+            }
+            if (d1 < 0) a = xk; else b = xk;
+            double next = d2 > 0 ? xk - d1 / d2 : (a + b) / 2;
+            if ((next <= a) || (next >= b)) next = (a + b) / 2;
+            double step = fabs(next - xk);
+            xk = next;
+            if ((step < epsilon / 2) || (fabs(b - a) < epsilon))
+            {
+                x = xk;
+                return;
+            }
+            if (const char* reason = budgetExceeded()) {
+                stop(reason, a, b);
+                x = xk;
+                return;
+            }
+        }
+        throw MyError("Достигнут предел кол-ва итераций!");
+    }
+    /**
+     * Проверка найденного минимума: значение в x не больше (с
+     * точностью до округления), чем на концах отрезка [x - eps/2;
+     * x + eps/2] в пределах [left;right]. Для унимодальной функции
+     * минимум тогда лежит в этом отрезке шириной eps.
+     */
+    bool verifyBracket(const Function& fun)
+    {
+        double at = double(x);
+        double lo = std::max(left, at - epsilon / 2);
+        double hi = std::min(right, at + epsilon / 2);
+        double y = evaluate(fun, at);
+        double noise = 4 * std::numeric_limits<double>::epsilon() * fabs(y);
+        return ((lo >= at) || (y <= evaluate(fun, lo) + noise))
+            && ((hi <= at) || (y <= evaluate(fun, hi) + noise));
+    }
+    /**
+     * Гонка методов: золотое сечение, Брент, Ньютон и чебышёвская
+     * аппроксимация решают задачу одновременно с общим кэшем значений;
+     * первый, чей ответ подтверждён отрезком шириной eps (см.
+     * verifyBracket), побеждает, остальные отменяются. Победы
+     * запоминаются, и если для функции один метод обычно выигрывает,
+     * дальше запускается только он.
+     */
+    void findMinimumPortfolio(const Function& fun)
+    {
+        static const int racers[] = {
+            METHOD_GOLDEN, METHOD_BRENT, METHOD_NEWTON, METHOD_CHEBYSHEV
+        };
+        RaceStats::Key key = RaceStats::key(functionId, fun);
+        int learned = stats->preferred(key);
+        std::vector<int> methods;
+        if (learned >= 0)
+            methods.push_back(learned);
+        else
+            methods.assign(std::begin(racers), std::end(racers));
+
+        if (!cache)
+            cache = std::make_shared<EvalCache>();
+        // участники останавливаются и при отмене всего решения
+        CancelToken race = token.child();
+        std::vector<Problem> subs(methods.size(), *this);
+        std::mutex mtx;
+        int first = -1;
+        std::exception_ptr error;
+        Parallel::forEach(methods.size(), methods.size(), [&](size_t i) {
+            Problem& sub = subs[i];
+            sub.method = methods[i];
+            sub.setCancelToken(race);
+            bool verified = false;
+            try {
+                sub.run(fun);
+                // точку без отрезка (Ньютон, аппроксимация) - проверить
+                verified = !sub.isStopped() && sub.verifyBracket(fun);
+            }
+            catch (...) {
+                std::lock_guard<std::mutex> lock(mtx);
+                if (!error) error = std::current_exception();
+                return;
+            }
+            std::lock_guard<std::mutex> lock(mtx);
+            if ((first < 0) && verified) {
+                first = i;
+                race.cancel();
+            }
+        });
+        int total = 0;
+        for (const Problem& sub : subs) total += sub.getEvaluations();
+        if (first < 0) {
+            // никто не достиг точности: ошибка или исчерпаны ограничения
+            for (size_t i = 0; i < subs.size(); ++i) {
+                if (subs[i].isStopped() && !token.isCancelled()) first = i;
+            }
+            if (first < 0) {
+                if (error) std::rethrow_exception(error);
+                if (token.isCancelled()) throw MyError("Отменено");
+                throw MyError("Ни один метод не подтвердил минимум");
+            }
+        }
+        else {
+            stats->record(key, methods[first], METHOD_COUNT);
+        }
+        const Problem& win = subs[first];
+        x = win.x;
+        iterations = win.iterations;
+        argRange = win.argRange;
+        minRange = win.minRange;
+        minima = win.minima;
+        stopReason = win.stopReason;
+        winner = methods[first];
+        evaluations = Counter(total);
+    }
+    /**
+     * Поиск минимума золотым сечением, начиная с узкого отрезка около
+     * guess шириной порядка предыдущего сдвига step. Если минимум в
+     * отрезке не окружён (значение в guess не меньше, чем на концах),
+     * отрезок расширяется вчетверо, вплоть до всего [left;right].
+     * Возвращает NaN, если минимум не найден.
+     */
+    double warmSolve(const Function& fun, double guess, double step, bool& warm)
+    {
+        warm = false;
+        if (guess == guess) {
+            double fg = evaluate(fun, guess);
+            double w = std::max(2 * step, 8 * epsilon);
+            while (true) {
+                double lo = std::max(left, guess - w);
+                double hi = std::min(right, guess + w);
+                if ((lo < guess) && (guess < hi) && (fg < evaluate(fun, lo))
+                    && (fg < evaluate(fun, hi))) {
+                    GoldenStepper st(lo, hi, epsilon, ITERATION_LIMIT);
+                    if (drive(st, fun) || st.isFailed())
+                        return std::numeric_limits<double>::quiet_NaN();
+                    warm = true;
+                    return st.result();
+                }
+                if ((lo <= left) && (hi >= right))
+                    break;
+                w *= 4;
+            }
+        }
+        try {
+            findMinimum(fun);
+            return x;
+        }
+        catch (MyError&) {
+            return std::numeric_limits<double>::quiet_NaN();
+        }
+    }
+    /**
+     * Выбор метода по нескольким пробным значениям функции: число
+     * локальных минимумов на сетке говорит о многоэкстремальности,
+     * знаки вторых разностей - о выпуклости, отношение третьих разностей
+     * ко вторым - о гладкости.
+     */
+    int chooseMethod(const Function& fun)
+    {
+        const int n = 9;
+        double xs[n], ys[n];
+        for (int i = 0; i < n; ++i)
+            xs[i] = left + (right - left) * i / (n - 1);
+        fun.calcValues(xs, ys, n);
+        evaluations += n;
+        probes = n;
+        if (cache) {
+            for (int i = 0; i < n; ++i) cache->store(fun, xs[i], ys[i]);
+        }
+        int dips = 0;
+        for (int i = 1; i + 1 < n; ++i) {
+            if ((ys[i] < ys[i - 1]) && (ys[i] <= ys[i + 1])) ++dips;
+        }
+        if (dips > 1) {
+            try {
+                fun.calcRange(Interval(left, right));
+                decision = "несколько минимумов";
+                return METHOD_INTERVAL;
+            }
+            catch (MyError&) {
+                decision = "несколько минимумов, нет интервальной оценки";
+                return METHOD_CHEBYSHEV;
+            }
+        }
+        bool convex = true;
+        double d2max = 0.0, d3max = 0.0;
+        for (int i = 1; i + 1 < n; ++i) {
+            double d2 = ys[i + 1] - 2 * ys[i] + ys[i - 1];
+            if (!(d2 > 0)) convex = false;
+            d2max = std::max(d2max, fabs(d2));
+            if (i + 2 < n) {
+                double d3 = ys[i + 2] - 3 * ys[i + 1] + 3 * ys[i] - ys[i - 1];
+                d3max = std::max(d3max, fabs(d3));
+            }
+        }
+        bool smooth = d3max <= d2max;
+        if (smooth && convex) {
+            decision = "гладкая выпуклая";
+            return METHOD_NEWTON;
+        }
+        if (smooth) {
+            decision = "гладкая";
+            return METHOD_BRENT;
+        }
+        decision = "негладкая";
+        return METHOD_GOLDEN;
+    }
+    /**
+     * Поиск минимума методом, выбранным по пробным значениям.
+     */
+    void findMinimumAuto(const Function& fun)
+    {
+        int m = chooseMethod(fun);
+        method = m;
+        try {
+            solveWith(fun);
+        }
+        catch (...) {
+            method = METHOD_AUTO;
+            chosen = m;
+            throw;
+        }
+        method = METHOD_AUTO;
+        chosen = m;
+    }
+    /**
+     * Минимум многочлена без итераций: среди корней f'(x) = 0 на
+     * отрезке выбирается точка с наименьшим значением функции. Если
+     * функция - не многочлен, возвращает false.
+     */
+    bool findMinimumPolynomial(const Function& fun)
+    {
+        const Expression* e = fun.getExpression();
+        Polynomial::Coeffs c;
+        if (!e || !Polynomial::fromExpression(*e, c) || (Polynomial::degree(c) < 2))
+            return false;
+        if (!hasMinimum(fun))
+            throw MyError("Похоже, нет минимума на заданном отрезке!");
+        double best = HUGE_VAL;
+        for (double r : Polynomial::roots(Polynomial::derivative(c), left, right)) {
+            double y = evaluate(fun, r);
+            if (y < best) {
+                best = y;
+                x = r;
+            }
+        }
+        if (best == HUGE_VAL)
+            return false;
+        iterations = 0;
+        retainedFun = 0;
+        degree = Polynomial::degree(c);
+        return true;
+    }
+    /**
+     * Поиск минимума методом Брента.
+     */
+    void findMinimumBrent(const Function& fun)
+    {
+        if (!hasMinimum(fun))
+            throw MyError("Похоже, нет минимума на заданном отрезке!");
+        BrentStepper st(left, right, epsilon, ITERATION_LIMIT);
+        if (const char* reason = drive(st, fun)) {
+            iterations = st.getIterations();
+            stop(reason, st.bracket().lo, st.bracket().hi);
+            x = st.result();
+            return;
+        }
+        if (st.isFailed())
+            throw MyError("Достигнут предел кол-ва итераций!");
+        iterations = st.getIterations();
+        x = st.result();
+    }
+    /**
+     * Золотое сечение с упреждающими вычислениями. Пока вычисляется
+     * очередная точка, в других потоках вычисляются обе точки, которые
+     * могут понадобиться на следующем шаге (какая именно - зависит от
+     * сравнения). За время одного вычисления функции делается два шага;
+     * неиспользованное значение остаётся в кэше. Потоки создаются один
+     * раз на всё решение; их столько, сколько задано setThreads (по
+     * умолчанию - аппаратных), но не больше трёх: больше точек за шаг
+     * не вычисляется.
+     */
+    void findMinimumSpeculative(const Function& fun)
+    {
+        if (!hasMinimum(fun))
+            throw MyError("Похоже, нет минимума на заданном отрезке!");
+        const double inf = std::numeric_limits<double>::infinity();
+        WorkerPool pool(std::min(threads, 3));
+        Golden g(left, right);
+        double xs[3] = { g.x1, g.x2, 0.0 };
+        double ys[3];
+        pool.forEach(2, [&](size_t i) { ys[i] = evaluate(fun, xs[i]); });
+        g.y1 = ys[0];
+        g.y2 = ys[1];
+        iterations = 0;
+        while (iterations < ITERATION_LIMIT) {
+            // следующая точка и оба её возможных преемника
+            Golden lo = g, hi = g;
+            lo.advance(-inf);
+            hi.advance(inf);
+            xs[0] = g.probe();
+            xs[1] = lo.probe();
+            xs[2] = hi.probe();
+            pool.forEach(3, [&](size_t i) { ys[i] = evaluate(fun, xs[i]); });
+            for (int step = 0; step < 2; ++step) {
+                ++iterations;
+                double next = g.probe();
+                g.advance(next == xs[0] ? ys[0] : next == xs[1] ? ys[1]
+                    : next == xs[2] ? ys[2] : evaluate(fun, next));
+                if (fabs(g.b - g.a) < epsilon)
+                {
+                    x = (g.a + g.b) / 2;
+                    return;
+                }
+            }
+            if (const char* reason = budgetExceeded()) {
+                stop(reason, g.a, g.b);
+                return;
+            }
+        }
+        throw MyError("Достигнут предел кол-ва итераций!");
+    }
+    /**
+     * Гарантированный поиск глобального минимума методом ветвей и границ.
+     * Отрезки, у которых нижняя оценка больше лучшей известной верхней,
+     * отбрасываются; очередь отрезков разбирается несколькими потоками.
+     * Функция должна поддерживать интервальную арифметику.
+     */
+    void findGlobalMinimum(const Function& fun)
+    {
+        struct Box
+        {
+            Interval    x;      // отрезок
+            double      lower;  // нижняя оценка функции на нём
+            bool operator<(const Box& other) const
+            {
+                return lower > other.lower; // сначала перспективные
+            }
+        };
+        Interval whole(left, right);
+        Box first = { whole, fun.calcRange(whole).lo };
+
+        std::vector<Box>        queue(1, first);    // куча по lower
+        std::vector<Box>        done;               // отрезки уже < epsilon
+        std::mutex              mtx;
+        std::condition_variable cv;
+        std::atomic<double>     best(std::numeric_limits<double>::infinity());
+        std::exception_ptr      error;
+        int                     busy = 0;
+        int                     processed = 0;
+        const char*             reason = nullptr;   // причина остановки
+        double                  eps = epsilon;
+
+        auto improve = [&best](double value) {
+            double cur = best.load();
+            while ((value < cur) && !best.compare_exchange_weak(cur, value)) {}
+        };
+        auto worker = [&]() {
+            std::unique_lock<std::mutex> lock(mtx);
+            while (true) {
+                while (queue.empty() && (busy > 0)) cv.wait(lock);
+                if (!reason) reason = budgetExceeded();
+                if (queue.empty() || error || reason
+                    || (processed >= ITERATION_LIMIT))
+                    break;
+                std::pop_heap(queue.begin(), queue.end());
+                Box box = queue.back();
+                queue.pop_back();
+                ++busy;
+                ++processed;
+                lock.unlock();
+
+                Box parts[2];
+                int count = 0;
+                try {
+                    if (box.lower <= best.load()) {
+                        Interval range = fun.calcRange(box.x);
+                        double m = box.x.mid();
+                        improve(fun.calcRange(Interval(m)).hi);
+                        evaluations += 2;
+                        if (range.lo <= best.load()) {
+                            box.lower = std::max(box.lower, range.lo);
+                            if (box.x.width() < eps) {
+                                count = -1;
+                            }
+                            else {
+                                parts[0].x = Interval(box.x.lo, m);
+                                parts[1].x = Interval(m, box.x.hi);
+                                parts[0].lower = parts[1].lower = box.lower;
+                                count = 2;
+                            }
+                        }
+                    }
+                }
+                catch (...) {
+                    lock.lock();
+                    error = std::current_exception();
+                    --busy;
+                    cv.notify_all();
+                    break;
+                }
+
+                lock.lock();
+                if (count < 0)
+                    done.push_back(box);
+                for (int i = 0; i < count; ++i) {
+                    queue.push_back(parts[i]);
+                    std::push_heap(queue.begin(), queue.end());
+                }
+                --busy;
+                cv.notify_all();
+            }
+            cv.notify_all();
+        };
+
+        std::vector<std::thread> pool;
+        for (int i = 1; i < threads; ++i)
+            pool.push_back(std::thread(worker));
+        worker();
+        for (auto& t : pool) t.join();
+
+        if (error)
+            std::rethrow_exception(error);
+        if (reason)
+            done.insert(done.end(), queue.begin(), queue.end());
+        else if (!queue.empty())
+            throw MyError("Достигнут предел кол-ва итераций!");
+
+        double upper = best.load();
+        bool found = false;
+        for (const Box& box : done) {
+            if (box.lower > upper) continue;
+            if (!found) {
+                argRange = box.x;
+                minRange = Interval(box.lower, upper);
+                found = true;
+            }
+            else {
+                argRange = Interval::hull(argRange, box.x);
+                minRange.lo = std::min(minRange.lo, box.lower);
+            }
+        }
+        if (!found)
+            throw MyError("Не удалось локализовать минимум");
+        iterations = processed;
+        x = argRange.mid();
+        stopReason = reason;
+    }
+    /**
+     * Поиск всех локальных минимумов гладкой функции через её
+     * чебышёвскую аппроксимацию на [left;right]. Наименьший из них
+     * выбирается по точным значениям функции.
+     */
+    void findAllMinima(const Function& fun)
+    {
+        const size_t CHUNK = 256;   // точек между проверками ограничений
+        const char* reason = nullptr;
+        ChebyshevProxy proxy = ChebyshevProxy::build(
+            [&](const double* xs, double* ys, size_t n) {
+                for (size_t i = 0; i < n; i += CHUNK) {
+                    if ((reason = budgetExceeded()) != nullptr)
+                        return false;
+                    evaluateMany(fun, xs + i, ys + i, std::min(CHUNK, n - i));
+                }
+                return true;
+            }, left, right, 1e-14);
+        if (!proxy.isBuilt()) {
+            iterations = proxy.getEvaluations();
+            minima.clear();
+            stop(reason, left, right);
+            return;
+        }
+        std::vector<double> found = proxy.findMinima();
+        if (found.empty())
+            throw MyError("Похоже, нет минимума на заданном отрезке!");
+        std::vector<double> values(found.size());
+        evaluateMany(fun, found.data(), values.data(), found.size());
+        size_t best = std::min_element(values.begin(), values.end())
+            - values.begin();
+        minima.swap(found);
+        iterations = proxy.getEvaluations() + minima.size();
+        x = minima[best];
+    }
+    /**
+     * Поиск минимума k-делением для дорогих функций: за итерацию
+     * вычисляется сразу k внутренних точек в k потоках, и отрезок
+     * сужается до соседей лучшей точки, т.е. примерно в (k+1)/2 раз.
+     * Уже вычисленные точки, попавшие в новый отрезок, используются
+     * повторно, а новые точки ставятся в самые длинные промежутки.
+     */
+    void findMinimumParallel(const Function& fun)
+    {
+        if (!hasMinimum(fun))
+            throw MyError("Похоже, нет минимума на заданном отрезке!");
+        struct Point
+        {
+            double x;
+            double y;
+            bool operator<(const Point& other) const { return x < other.x; }
+        };
+        int k = std::max(2, threads);
+        double a = left;
+        double b = right;
+        std::vector<Point> known;   // вычисленные точки внутри (a;b)
+        std::vector<Point> fresh(k);
+        iterations = 0;
+        while (iterations < ITERATION_LIMIT) {
+            ++iterations;
+            // раскладываем k новых точек по промежуткам между известными
+            std::vector<double> edges(1, a);
+            for (const Point& pt : known) edges.push_back(pt.x);
+            edges.push_back(b);
+            std::vector<int> counts(edges.size() - 1, 0);
+            for (int i = 0; i < k; ++i) {
+                size_t widest = 0;
+                for (size_t g = 1; g < counts.size(); ++g) {
+                    if ((edges[g + 1] - edges[g]) / (counts[g] + 1) >
+                        (edges[widest + 1] - edges[widest]) / (counts[widest] + 1))
+                        widest = g;
+                }
+                ++counts[widest];
+            }
+            size_t n = 0;
+            for (size_t g = 0; g < counts.size(); ++g) {
+                double step = (edges[g + 1] - edges[g]) / (counts[g] + 1);
+                for (int j = 1; j <= counts[g]; ++j)
+                    fresh[n++].x = edges[g] + step * j;
+            }
+            Parallel::forEach(k, k, [&](size_t i) {
+                fresh[i].y = evaluate(fun, fresh[i].x);
+            });
+
+            known.insert(known.end(), fresh.begin(), fresh.end());
+            std::sort(known.begin(), known.end());
+            size_t best = 0;
+            for (size_t i = 1; i < known.size(); ++i) {
+                if (known[i].y < known[best].y) best = i;
+            }
+            double na = best > 0 ? known[best - 1].x : a;
+            double nb = best + 1 < known.size() ? known[best + 1].x : b;
+            a = na;
+            b = nb;
+            known.erase(std::remove_if(known.begin(), known.end(),
+                [a, b](const Point& pt) { return (pt.x <= a) || (pt.x >= b); }),
+                known.end());
+            if (fabs(b - a) < epsilon)
+            {
+                x = (a + b) / 2;
+                return;
+            }
+            if (const char* reason = budgetExceeded()) {
+                stop(reason, a, b);
+                return;
+            }
+        }
+        throw MyError("Достигнут предел кол-ва итераций!");
+    }
+};
+
+/**
+ * Слежение за минимумом функции, меняющейся со временем: f(x, t) из
+ * семейства с параметром p = t. Между вызовами update(t) хранится
+ * окно около последнего минимума, сдвинутое на его последнее
+ * смещение. На новом шаге окно проверяется тремя вычислениями (центр
+ * и края), расширяется, только если минимум из него ушёл, и
+ * уточняется методом Брента, начиная с параболы по этим трём точкам.
+ * Ширина окна подстраивается под ошибку предсказания смещения.
+ */
+class MinimumTracker
+{
+    const ParametricFunction&   family;     // семейство
+    double                      left;       // допустимый отрезок
+    double                      right;
+    double                      eps;        // точность
+    double                      x;          // последний минимум
+    double                      velocity;   // его смещение за шаг
+    double                      width;      // полуширина окна проверки
+    int                         evaluations;// кол-во вычислений всего
+    int                         ticks;      // кол-во шагов
+    int                         widenings;  // шагов с расширением окна
+
+    double evaluate(const Function& fun, double at)
+    {
+        ++evaluations;
+        return fun.calcValue(at);
+    }
+
+public:
+
+    MinimumTracker(const ParametricFunction& fam, double l, double r,
+        double epsilon) :
+        family(fam), left(l), right(r), eps(epsilon),
+        x(std::numeric_limits<double>::quiet_NaN()), velocity(0.0), width(0.0),
+        evaluations(0), ticks(0), widenings(0)
+    {
+        if (!(l < r))
+            throw MyError("Неверный отрезок");
+    }
+    /**
+     * Минимум в момент t.
+     */
+    double update(double t)
+    {
+        BoundFunction fun(family, t);
+        ++ticks;
+        std::unique_ptr<BrentStepper> st;
+        if (x == x) {
+            // проверка окна [c - h; c + h] около предсказанного минимума c
+            double h = width;
+            double c = std::min(right, std::max(left, x + velocity));
+            double a = std::max(left, c - h);
+            double b = std::min(right, c + h);
+            double fc = evaluate(fun, c);
+            double fa = evaluate(fun, a), fb = evaluate(fun, b);
+            bool widened = false;
+            // минимум ушёл: шаги с удвоением в сторону убывания
+            while ((fa <= fc) && (a > left)) {
+                b = c; fb = fc;
+                c = a; fc = fa;
+                h *= 2;
+                a = std::max(left, c - h);
+                fa = evaluate(fun, a);
+                widened = true;
+            }
+            while ((fb < fc) && (b < right)) {
+                a = c; fa = fc;
+                c = b; fc = fb;
+                h *= 2;
+                b = std::min(right, c + h);
+                fb = evaluate(fun, b);
+                widened = true;
+            }
+            if (widened) ++widenings;
+            if ((fc < fa) && (fc < fb))
+                st.reset(new BrentStepper(a, fa, c, fc, b, fb, eps, Problem::ITERATION_LIMIT));
+            else
+                st.reset(new BrentStepper(a, b, eps, Problem::ITERATION_LIMIT));
+        }
+        else
+            st.reset(new BrentStepper(left, right, eps, Problem::ITERATION_LIMIT));
+        while (!st->isDone())
+            st->resume(evaluate(fun, st->request()));
+        if (st->isFailed())
+            throw MyError("Достигнут предел кол-ва итераций!");
+        double found = st->result();
+        if (x == x) {
+            double error = found - (x + velocity);
+            width = std::max(4 * fabs(error), 4 * eps);
+            velocity = found - x;
+        }
+        else
+            width = 4 * eps;
+        x = found;
+        return x;
+    }
+    double getMinimum() const { return x; }
+    int getEvaluations() const { return evaluations; }
+    int getTicks() const { return ticks; }
+    int getWidenings() const { return widenings; }
+};
+
+/**
+ * Поиск минимума в унимодальном массиве double на диске, который может
+ * быть больше памяти. Файл отображается в память, индекс минимума
+ * ищется методом Фибоначчи. Перед чтением очередной точки ОС
+ * получает подсказку подгрузить страницы обеих возможных следующих
+ * точек, так что ожидание диска идёт параллельно с работой.
+ * Принимается файл таблицы (TAB1, берётся столбец y) или просто
+ * массив double.
+ */
+class ArraySearch
+{
+public:
+    struct Result
+    {
+        uint64_t    index;      // индекс минимума
+        double      value;      // значение в нём
+        double      x;          // абсцисса (для таблицы) или индекс
+        Interval    bracket;    // последний отрезок поиска
+        int         probes;     // прочитано элементов
+        int         iterations; // шагов метода
+        long        minorFaults;// ошибок страниц без чтения диска
+        long        majorFaults;// ошибок страниц с чтением диска
+        double      elapsed;    // время, мс
+    };
+
+    /**
+     * Счётчики ошибок страниц процесса (на Windows не считаются).
+     */
+    static void pageFaults(long& minor, long& major)
+    {
+#ifndef _WIN32
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        minor = usage.ru_minflt;
+        major = usage.ru_majflt;
+#else
+        minor = major = 0;
+#endif
+    }
+    /**
+     * Поиск в файле path на индексах [from; to] (to = 0 - до конца).
+     */
+    static Result run(const std::string& path, uint64_t from, uint64_t to,
+        bool prefetch)
+    {
+        MappedFile file(path);
+        const char* base = file.getData();
+        uint64_t count = file.getSize() / sizeof(double);
+        size_t offset = 0;
+        const double* xs = nullptr;
+        if ((file.getSize() >= 16) && (std::memcmp(base, "TAB1", 4) == 0)) {
+            std::memcpy(&count, base + 8, sizeof(count));
+            // до умножения: count * 16 может переполниться
+            if (count > (file.getSize() - 16) / (2 * sizeof(double)))
+                throw MyError("Неверный формат табличного файла");
+            xs = reinterpret_cast<const double*>(base + 16);
+            offset = 16 + count * sizeof(double);
+        }
+        if (count == 0)
+            throw MyError("Файл пуст");
+        if ((to == 0) || (to >= count))
+            to = count - 1;
+        if (from > to)
+            throw MyError("Неверный диапазон индексов");
+        const double* data = reinterpret_cast<const double*>(base + offset);
+
+        Result res;
+        long minor0, major0;
+        pageFaults(minor0, major0);
+        auto start = std::chrono::steady_clock::now();
+        FibonacciStepper st(from, to, 200);
+        res.probes = 0;
+        while (!st.isDone()) {
+            uint64_t i = uint64_t(st.request());
+            if (prefetch) {
+                // обе возможные следующие точки известны заранее
+                FibonacciStepper lo(st), hi(st);
+                lo.resume(-HUGE_VAL);
+                hi.resume(HUGE_VAL);
+                for (const Stepper* s : { &lo, &hi }) {
+                    uint64_t j = uint64_t(s->request());
+                    if (!s->isDone() && (j <= to))
+                        file.prefetch(offset + j * sizeof(double), sizeof(double));
+                }
+            }
+            if (i <= to) {
+                st.resume(data[i]);
+                ++res.probes;
+            }
+            else
+                st.resume(HUGE_VAL);
+        }
+        res.elapsed = std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - start).count();
+        pageFaults(res.minorFaults, res.majorFaults);
+        res.minorFaults -= minor0;
+        res.majorFaults -= major0;
+        res.index = uint64_t(st.result());
+        res.value = data[res.index];
+        res.x = xs ? xs[res.index] : double(res.index);
+        res.bracket = st.bracket();
+        res.iterations = st.getIterations();
+        if (st.isFailed())
+            throw MyError("Достигнут предел кол-ва итераций!");
+        return res;
+    }
+    /**
+     * Поиск с выводом результата.
+     */
+    static void print(const std::string& path, uint64_t from, uint64_t to,
+        bool prefetch)
+    {
+        Result res = run(path, from, to, prefetch);
+        std::cout << std::setprecision(15)
+            << "Минимум: индекс " << res.index << ", x = " << res.x
+            << ", y = " << res.value << std::endl
+            << "Итераций: " << res.iterations << ", прочитано элементов: "
+            << res.probes << std::endl
+            << "Ошибок страниц: " << res.minorFaults << " без чтения диска, "
+            << res.majorFaults << " с чтением диска"
+            << (prefetch ? "" : " (без подсказок ОС)") << std::endl
+            << "Время: " << res.elapsed << " мс" << std::endl;
+    }
+};
+
+/**
+ * Минимум по скользящему окну из последних size отсчётов потока.
+ * Монотонная очередь (индексы с возрастающими значениями) хранится в
+ * кольцевом буфере вместе с самими отсчётами окна, так что добавление
+ * отсчёта - амортизированно O(1) и без выделения памяти.
+ */
+class WindowMinimum
+{
+    std::vector<double>     values; // отсчёты окна, values[t % size]
+    std::vector<uint64_t>   queue;  // монотонная очередь индексов
+    size_t                  size;   // длина окна
+    size_t                  head;   // начало очереди в queue
+    size_t                  length; // длина очереди
+    uint64_t                count;  // кол-во принятых отсчётов
+
+    uint64_t& at(size_t i) { return queue[(head + i) % size]; }
+    uint64_t front() const { return queue[head]; }
+
+public:
+
+    WindowMinimum(size_t window) :
+        values(window), queue(window), size(window),
+        head(0), length(0), count(0)
+    {
+        if (window == 0)
+            throw MyError("Длина окна должна быть положительной");
+    }
+    /**
+     * Добавление отсчёта. Возвращает true, если сменился минимум окна.
+     */
+    bool push(double y)
+    {
+        uint64_t old = length ? front() : UINT64_MAX;
+        uint64_t t = count++;
+        values[t % size] = y;
+        // вытесненный окном минимум и все отсчёты не меньше нового
+        if (length && (front() + size <= t)) {
+            head = (head + 1) % size;
+            --length;
+        }
+        while (length && (values[at(length - 1) % size] >= y))
+            --length;
+        at(length++) = t;
+        return front() != old;
+    }
+    /**
+     * Кол-во принятых отсчётов.
+     */
+    uint64_t getCount() const { return count; }
+    /**
+     * Индекс минимума в потоке.
+     */
+    uint64_t getArgmin() const { return front(); }
+    /**
+     * Минимальное значение в окне.
+     */
+    double getMinimum() const { return values[front() % size]; }
+    /**
+     * Уточнение минимума параболой по соседним отсчётам окна:
+     * дробный индекс x и значение y вершины. Если соседей в окне нет,
+     * возвращается сам отсчёт.
+     */
+    void refine(double& x, double& y) const
+    {
+        uint64_t m = front();
+        x = double(m);
+        y = values[m % size];
+        if ((m == 0) || (m + 1 >= count) || (m + size <= count))
+            return;
+        double y0 = values[(m - 1) % size], y2 = values[(m + 1) % size];
+        double d = y0 - 2 * y + y2;
+        if (d <= 0) return;
+        double shift = (y0 - y2) / (2 * d);
+        x += shift;
+        y -= (y0 - y2) * shift / 4;
+    }
+
+    /**
+     * Чтение чисел из потока с выводом каждой смены минимума окна.
+     * В режиме follow по достижении конца файла ждёт новых данных,
+     * как tail -f.
+     */
+    static void run(size_t window, FILE* in, bool follow)
+    {
+        WindowMinimum win(window);
+        const size_t CHUNK = 1 << 16;
+        std::vector<char> buf(CHUNK + 1);
+        size_t kept = 0;    // недочитанное число из прошлого блока
+        char line[128];     // строка вывода
+        auto start = std::chrono::steady_clock::now();
+        while (true) {
+            size_t got = fread(buf.data() + kept, 1, CHUNK - kept, in);
+            bool eof = got == 0;
+            if (eof && follow) {
+                clearerr(in);
+                std::cout.flush();
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                continue;
+            }
+            size_t len = kept + got;
+            // последнее число может продолжиться в следующем блоке
+            size_t end = len;
+            if (!eof) {
+                while ((end > 0) && !isspace((unsigned char)buf[end - 1]))
+                    --end;
+                if (end == 0) {
+                    if (len == CHUNK)
+                        throw MyError("Слишком длинное число во входных данных");
+                    kept = len;
+                    continue;
+                }
+            }
+            char next = buf[end];
+            buf[end] = '\0';
+            const char* p = buf.data();
+            while (true) {
+                while (isspace((unsigned char)*p)) ++p;
+                if (!*p) break;
+                double y = parseNumber(p);
+                // вывод при смене минимума и когда у него появился
+                // правый сосед, то есть стало возможно уточнение
+                bool changed = win.push(y);
+                if (changed || (win.getArgmin() + 2 == win.getCount())) {
+                    // snprintf в разы быстрее вывода double через cout
+                    double x, v;
+                    win.refine(x, v);
+                    int n = snprintf(line, sizeof(line), "%llu %llu %.10g %.10g %.10g\n",
+                        (unsigned long long)(win.getCount() - 1),
+                        (unsigned long long)win.getArgmin(),
+                        win.getMinimum(), x, v);
+                    std::cout.write(line, n);
+                }
+            }
+            if (eof) break;
+            buf[end] = next;
+            kept = len - end;
+            std::memmove(buf.data(), buf.data() + end, kept);
+        }
+        double sec = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count();
+        std::cout.flush();
+        std::cerr << "Отсчётов: " << win.getCount() << ", "
+            << win.getCount() / sec / 1e6 << " млн/с" << std::endl;
+    }
+
+private:
+
+    /**
+     * Разбор десятичного числа без учёта локали (strtod при русской
+     * локали ждёт запятую). Точность - до единиц последнего разряда.
+     */
+    static double parseNumber(const char*& p)
+    {
+        bool negative = *p == '-';
+        if ((*p == '-') || (*p == '+')) ++p;
+        uint64_t mantissa = 0;
+        int scale = 0, digits = 0;
+        bool any = false;
+        for (; isdigit((unsigned char)*p); ++p, any = true) {
+            if (digits < 19) {
+                mantissa = mantissa * 10 + (*p - '0');
+                if (mantissa) ++digits;
+            }
+            else
+                ++scale;
+        }
+        if (*p == '.') {
+            for (++p; isdigit((unsigned char)*p); ++p, any = true) {
+                if (digits < 19) {
+                    mantissa = mantissa * 10 + (*p - '0');
+                    if (mantissa) ++digits;
+                    --scale;
+                }
+            }
+        }
+        if (!any)
+            throw MyError("Ошибка во входных данных");
+        if ((*p == 'e') || (*p == 'E')) {
+            const char* q = p + 1;
+            bool minus = *q == '-';
+            if ((*q == '-') || (*q == '+')) ++q;
+            if (isdigit((unsigned char)*q)) {
+                int e = 0;
+                for (; isdigit((unsigned char)*q); ++q)
+                    e = std::min(e * 10 + (*q - '0'), 10000);
+                scale += minus ? -e : e;
+                p = q;
+            }
+        }
+        if (*p && !isspace((unsigned char)*p))
+            throw MyError("Ошибка во входных данных");
+        // степени 10 до 22 представимы в double точно
+        static const double powers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6,
+            1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17,
+            1e18, 1e19, 1e20, 1e21, 1e22 };
+        double y = double(mantissa);
+        if (scale < 0)
+            y /= -scale <= 22 ? powers[-scale] : pow(10.0, -scale);
+        else if (scale > 0)
+            y *= scale <= 22 ? powers[scale] : pow(10.0, scale);
+        return negative ? -y : y;
+    }
+};
+
+/**
+ * Меню взаимодействия с пользователем.
+ */
+class Menu
+{
+public:
+    /**
+     * Коды команд.
+     */
+    enum {
+        CMD_QUIT,
+        CMD_FUNC,
+        CMD_RANGE,
+        CMD_PRECISION,
+        CMD_SOLVE,
+        CMD_METHOD,
+        CMD_THREADS,
+        CMD_SPECULATIVE,
+        CMD_BUDGET,
+        CMD_SWEEP,
+        CMD_DEFINE,
+        CMD_PLUGIN,
+        CMD_COMBINE,
+
+        CMD_COUNT
+    };
+
+public:
+
+    /**
+     * Чтение строки с консоли.
+     */
+    static std::string readLine()
+    {
+        std::string str;
+        std::getline(std::cin, str);
+        return str;
+    }
+    /**
+     * Перевод строки в число (в общем случае любой тип) T.
+     */
+    template< class T > static T parse(const std::string& str)
+    {
+        std::istringstream iss(str);
+        T retval;
+        iss >> retval;
+        if (iss.fail())
+            throw MyError("Ошибка ввода");
+        return retval;
+    }
+    /**
+     * Пауза.
+     */
+    static void pause()
+    {
+        std::cout << "Нажмите <Enter>...";
+        readLine();
+    }
+    /**
+     * Ввод данных типа T.
+     */
+    template< typename T > static T input(const char* prompt)
+    {
+        std::cout << "Введите " << prompt << ": ";
+        return parse<T>(readLine());
+    }
+    /**
+     * Выбор функции.
+     */
+    static int readFunction(const FunctionRegistry& funcs)
+    {
+        std::cout << "0] Назад" << std::endl;
+        for (int i = 0; i < funcs.getSize(); ++i) {
+            std::cout << (i + 1) << "] "
+                << funcs.get(i).getName() << std::endl;
+        }
+        while (true) {
+            std::cout << "Команда:> ";
+            int index = parse<int>(readLine());
+            if ((index >= 0) && (index <= funcs.getSize())) return index;
+        }
+    }
+    /**
+     * Выбор семейства функций.
+     */
+    static int readFamily(const FunctionRegistry& funcs)
+    {
+        std::cout << "0] Назад" << std::endl;
+        for (int i = 0; i < funcs.getFamilyCount(); ++i) {
+            std::cout << (i + 1) << "] "
+                << funcs.getFamily(i).getName() << std::endl;
+        }
+        while (true) {
+            std::cout << "Команда:> ";
+            int index = parse<int>(readLine());
+            if ((index >= 0) && (index <= funcs.getFamilyCount())) return index;
+        }
+    }
+    /**
+     * Выбор метода поиска.
+     */
+    static int readMethod()
+    {
+        std::cout << "0] Назад" << std::endl;
+        for (int i = 0; i < Problem::METHOD_COUNT; ++i) {
+            std::cout << (i + 1) << "] "
+                << Problem::getMethodName(i) << std::endl;
+        }
+        while (true) {
+            std::cout << "Команда:> ";
+            int index = parse<int>(readLine());
+            if ((index >= 0) && (index <= Problem::METHOD_COUNT)) return index;
+        }
+    }
+    /**
+     * Вывод меню и получение выбранной команды.
+     */
+    static int readSelection(const Function& f, const Problem& prob)
+    {
+        std::cout << CMD_QUIT << "] Выход из программы" << std::endl;
+        std::cout << CMD_FUNC << "] Выбор функции (выбрана: "
+            << f.getName() << ")" << std::endl;
+        std::cout << CMD_RANGE << "] Выбор отрезка (выбран: "
+            << prob.getBoundsString() << ")" << std::endl;
+        std::cout << CMD_PRECISION << "] Выбор точности (выбрана: "
+            << prob.getPrecisionString() << ")" << std::endl;
+        std::cout << CMD_SOLVE << "] Поиск минимума" << std::endl;
+        std::cout << CMD_METHOD << "] Выбор метода (выбран: "
+            << Problem::getMethodName(prob.getMethod()) << ")" << std::endl;
+        std::cout << CMD_THREADS << "] Кол-во потоков (выбрано: "
+            << prob.getThreads() << ")" << std::endl;
+        std::cout << CMD_SPECULATIVE << "] Упреждающие вычисления для дорогих "
+            "функций (" << (prob.isSpeculative() ? "вкл" : "выкл") << ")"
+            << std::endl;
+        std::cout << CMD_BUDGET << "] Ограничения решения (вычислений: ";
+        if (prob.getMaxEvaluations() > 0)
+            std::cout << prob.getMaxEvaluations();
+        else
+            std::cout << "нет";
+        std::cout << ", время: ";
+        if (prob.getMaxTime() > 0)
+            std::cout << prob.getMaxTime() << " мс";
+        else
+            std::cout << "нет";
+        std::cout << ")" << std::endl;
+        std::cout << CMD_SWEEP << "] Серия задач по параметру" << std::endl;
+        std::cout << CMD_DEFINE << "] Новая функция (выражение)" << std::endl;
+        std::cout << CMD_PLUGIN << "] Подключить или обновить функцию из модуля"
+            << std::endl;
+        std::cout << CMD_COMBINE << "] Объединить функции..." << std::endl;
+        while (true) {
+            std::cout << "Команда:> ";
+            int index = parse<int>(readLine());
+            if ((index >= CMD_QUIT) && (index < CMD_COUNT)) return index;
+        }
+    }
+};
+
+/**
+ * Программа. Обработка ввода пользователя.
+ */
+class App
+{
+    FunctionRegistry functions; // реестр функций
+    Problem     problem;    // параметры задачи
+    int         current;    // выбранная функция
+
+public:
+
+    App() : functions(), problem(), current(0) {}
+
+    /**
+     * Подключение табличной функции из файла под именем name.
      */
-    void findMinimum(const Function& fun)
+    void addTable(const std::string& name, const std::string& path, bool cubic)
     {
-        if (!hasMinimum(fun))
-            throw MyError("Похоже, нет минимума на заданном отрезке!");
-        double a = left;
-        double b = right;
-        double rfi = 2 / (1 + sqrt(5));
-        double x1 = b - (b - a) * rfi;
-        double x2 = a + (b - a) * rfi;
-        double y1 = fun.calcValue(x1);
-        double y2 = fun.calcValue(x2);
-        iterations = 0;
-        while (iterations < ITERATION_LIMIT) {
-            ++iterations;
-            if (y1 >= y2) {
-                a = x1;
-                x1 = x2;
-                y1 = y2;
-                x2 = a + (b - a) * rfi;
-                y2 = fun.calcValue(x2);
+        functions.add(std::make_shared<TabulatedFunction>(name, path, cubic),
+            name);
+    }
+    /**
+     * Выбор функции по имени.
+     */
+    void selectByName(const std::string& name)
+    {
+        int index = functions.find(name);
+        if (index < 0)
+            throw MyError("Нет функции с таким именем");
+        current = index;
+    }
+    /**
+     * Подключение внешнего вычислителя как функции.
+     */
+    void addExternal(const std::string& command, size_t limit)
+    {
+        functions.add(std::make_shared<ExternalFunction>(command, limit));
+    }
+    /**
+     * Подключение функции из модуля (или новой версии, если модуль
+     * с этим путём уже подключён). Возвращает номер функции.
+     */
+    int addPlugin(const std::string& path)
+    {
+        return functions.replace(path, PluginFunction::load(path));
+    }
+    /**
+     * Добавление функции или семейства, заданных выражением.
+     */
+    void define(const std::string& name, const std::string& text)
+    {
+        bool family = false;
+        int id = functions.define(name, text, family);
+        if (!family) current = id;
+    }
+
+private:
+
+    void selectFunction()
+    {
+        int funcid = Menu::readFunction(functions);
+        if (funcid > 0) {
+            current = funcid - 1;
+            std::cout << "Выбрана "
+                << functions.get(current).getName() << std::endl;
+        }
+        else {
+            std::cout << "Отмена" << std::endl;
+        }
+    }
+    /**
+     * Смена метода поиска.
+     */
+    void selectMethod()
+    {
+        int m = Menu::readMethod();
+        if (m > 0) {
+            problem.setMethod(m - 1);
+            std::cout << "Выбран метод "
+                << Problem::getMethodName(problem.getMethod()) << std::endl;
+        }
+        else {
+            std::cout << "Отмена" << std::endl;
+        }
+    }
+    /**
+     * Смена  отрезка.
+     */
+    void selectRange()
+    {
+        std::cout << "Пустая строка оставит прежнее значение (в скобках)"
+            << std::endl;
+        double a = problem.getLeft(), b = problem.getRight();
+        std::cout << "Левая граница отрезка (" << a << "): ";
+        std::string s = Menu::readLine();
+        if (s.length() > 0) a = Menu::parse<double>(s);
+        std::cout << "Правая граница отрезка (" << b << "): ";
+        s = Menu::readLine();
+        if (s.length() > 0) b = Menu::parse<double>(s);
+        problem.setBounds(a, b);
+        std::cout << "Установлен отрезок "
+            << problem.getBoundsString() << std::endl;
+    }
+    /**
+     * Смена кол-ва потоков.
+     */
+    void setThreads()
+    {
+        int n = Menu::input<int>("кол-во потоков");
+        problem.setThreads(n);
+        std::cout << "Установлено потоков: "
+            << problem.getThreads() << std::endl;
+    }
+    /**
+     * Серия задач для семейства функций с параметром.
+     */
+    void sweep()
+    {
+        int famid = Menu::readFamily(functions);
+        if (famid == 0) {
+            std::cout << "Отмена" << std::endl;
+            return;
+        }
+        auto pin = functions.pin();
+        const ParametricFunction& fam = functions.getFamily(famid - 1);
+        double p0 = Menu::input<double>("начальное значение параметра");
+        double p1 = Menu::input<double>("конечное значение параметра");
+        int count = Menu::input<int>("кол-во значений параметра");
+        int way = Menu::input<int>("способ (1 - от соседа, 2 - все задачи одним пакетом)");
+        try {
+            auto start = std::chrono::steady_clock::now();
+            std::vector<Problem::SweepPoint> points = way == 2
+                ? problem.sweepBatch(fam, p0, p1, count)
+                : problem.sweep(fam, p0, p1, count);
+            double ms = std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - start).count();
+            const size_t SHOWN = 20;
+            long long total = 0;
+            int warm = 0;
+            for (size_t i = 0; i < points.size(); ++i) {
+                const Problem::SweepPoint& pt = points[i];
+                total += pt.evaluations;
+                if (pt.warm) ++warm;
+                if (i < SHOWN) {
+                    std::cout << "p = " << pt.param << ": минимум " << pt.x
+                        << " (" << pt.evaluations << " вычислений"
+                        << (pt.warm ? ", от соседа" : "") << ")" << std::endl;
+                }
+            }
+            if (points.size() > SHOWN)
+                std::cout << "... всего задач: " << points.size() << std::endl;
+            std::cout << "Время: " << ms << " мс, вычислений функции: " << total
+                << ", решено от соседа: " << warm << std::endl;
+        }
+        catch (std::exception& ex) {
+            std::cerr << "* " << ex.what() << std::endl;
+        }
+    }
+    /**
+     * Новая функция, заданная выражением.
+     */
+    void defineFunction()
+    {
+        std::cout << "Выражение от x, например 0.5*x^2 + sin(3*x); с "
+            "параметром p оно задаёт семейство функций. Существующее имя "
+            "даст новую версию функции" << std::endl;
+        std::cout << "Имя: ";
+        std::string name = Menu::readLine();
+        std::cout << "Выражение: ";
+        std::string text = Menu::readLine();
+        if (name.empty() || text.empty()) {
+            std::cout << "Отмена" << std::endl;
+            return;
+        }
+        try {
+            bool family = false;
+            int id = functions.define(name, text, family);
+            auto pin = functions.pin();
+            if (family) {
+                std::cout << "Добавлено семейство "
+                    << functions.getFamily(id).getName() << std::endl;
             }
             else {
-                b = x2;
-                x2 = x1;
-                y2 = y1;
-                x1 = b - (b - a) * rfi;
-                y1 = fun.calcValue(x1);
+                current = id;
+                std::cout << "Выбрана " << functions.get(id).getName()
+                    << " (версия " << functions.getRevision(id) << ")"
+                    << std::endl;
+            }
+        }
+        catch (std::exception& ex) {
+            std::cerr << "* " << ex.what() << std::endl;
+        }
+    }
+    /**
+     * Новая функция из уже имеющихся: сумма, произведение, умножение
+     * на число или композиция (у функций должно быть выражение).
+     */
+    void combineFunctions()
+    {
+        int way = Menu::input<int>("способ (1 - f + g, 2 - f * g, 3 - k * f, "
+            "4 - f(g(x)), 0 - назад)");
+        if ((way < 1) || (way > 4)) {
+            std::cout << "Отмена" << std::endl;
+            return;
+        }
+        std::cout << "Функция f:" << std::endl;
+        int f = Menu::readFunction(functions);
+        if (f == 0) {
+            std::cout << "Отмена" << std::endl;
+            return;
+        }
+        int g = 0;
+        double k = 0.0;
+        if (way == 3) {
+            k = Menu::input<double>("множитель k");
+        }
+        else {
+            std::cout << "Функция g:" << std::endl;
+            g = Menu::readFunction(functions);
+            if (g == 0) {
+                std::cout << "Отмена" << std::endl;
+                return;
+            }
+        }
+        try {
+            std::shared_ptr<const Function> result;
+            {
+                auto pin = functions.pin();
+                const Function& a = functions.get(f - 1);
+                switch (way) {
+                case 1: result = Combine::sum(a, functions.get(g - 1)); break;
+                case 2: result = Combine::product(a, functions.get(g - 1)); break;
+                case 3: result = Combine::scale(k, a); break;
+                default: result = Combine::compose(a, functions.get(g - 1)); break;
+                }
+            }
+            // та же комбинация ещё раз - выбор уже добавленной
+            current = functions.addUnique(result);
+            std::cout << "Выбрана " << result->getName() << std::endl;
+        }
+        catch (std::exception& ex) {
+            std::cerr << "* " << ex.what() << std::endl;
+        }
+    }
+    /**
+     * Подключение функции из модуля (разделяемой библиотеки).
+     */
+    void loadPlugin()
+    {
+        std::cout << "Путь к модулю: ";
+        std::string path = Menu::readLine();
+        if (path.empty()) {
+            std::cout << "Отмена" << std::endl;
+            return;
+        }
+        try {
+            current = addPlugin(path);
+            auto pin = functions.pin();
+            std::cout << "Выбрана " << functions.get(current).getName()
+                << " (версия " << functions.getRevision(current) << ")"
+                << std::endl;
+        }
+        catch (std::exception& ex) {
+            std::cerr << "* " << ex.what() << std::endl;
+        }
+    }
+    /**
+     * Смена ограничений решения.
+     */
+    void setBudget()
+    {
+        std::cout << "Пустая строка оставит прежнее значение (в скобках), "
+            "0 - без ограничения" << std::endl;
+        int evals = problem.getMaxEvaluations();
+        double ms = problem.getMaxTime();
+        std::cout << "Предел вычислений функции (" << evals << "): ";
+        std::string s = Menu::readLine();
+        if (s.length() > 0) evals = Menu::parse<int>(s);
+        std::cout << "Предел времени, мс (" << ms << "): ";
+        s = Menu::readLine();
+        if (s.length() > 0) ms = Menu::parse<double>(s);
+        problem.setBudget(evals, ms);
+        std::cout << "Ограничения установлены" << std::endl;
+    }
+    /**
+     * Переключение упреждающих вычислений.
+     */
+    void toggleSpeculative()
+    {
+        problem.setSpeculative(!problem.isSpeculative());
+        std::cout << "Упреждающие вычисления "
+            << (problem.isSpeculative() ? "включены" : "выключены")
+            << std::endl;
+    }
+    /**
+     * Смена точности.
+     */
+    void setPrecision()
+    {
+        int prec = Menu::input<int>("точность (знаков после запятой)");
+        problem.setPrecision(prec);
+        std::cout << "Установлена точность "
+            << problem.getPrecisionString() << std::endl;
+    }
+    /**
+     * Решение поиск минимума.
+     */
+    void solve()
+    {
+        try {
+            auto pin = functions.pin();
+            problem.setFunctionId(current);
+            problem.solve(functions.get(current));
+            std::cout << problem.getSolutionString() << std::endl;
+            std::cout << problem.getMetricsString() << std::endl;
+            std::string cache = CompileCache::instance().getMetricsString();
+            if (!cache.empty())
+                std::cout << cache << std::endl;
+        }
+        catch (std::exception& ex) {
+            std::cerr << "* " << ex.what() << std::endl;
+        }
+    }
+
+public:
+
+    /**
+     * Цикл обработки главного меню.
+     */
+    void run()
+    {
+        while (true) {
+            int cmd;
+            {
+                auto pin = functions.pin();
+                cmd = Menu::readSelection(functions.get(current), problem);
+            }
+            switch (cmd) {
+            case Menu::CMD_FUNC:        selectFunction(); break;
+            case Menu::CMD_RANGE:       selectRange(); break;
+            case Menu::CMD_PRECISION:   setPrecision(); break;
+            case Menu::CMD_SOLVE:       solve(); break;
+            case Menu::CMD_METHOD:      selectMethod(); break;
+            case Menu::CMD_THREADS:     setThreads(); break;
+            case Menu::CMD_SPECULATIVE: toggleSpeculative(); break;
+            case Menu::CMD_BUDGET:      setBudget(); break;
+            case Menu::CMD_SWEEP:       sweep(); break;
+            case Menu::CMD_DEFINE:      defineFunction(); break;
+            case Menu::CMD_PLUGIN:      loadPlugin(); break;
+            case Menu::CMD_COMBINE:     combineFunctions(); break;
+            default: return;
+            }
+            Menu::pause();
+        }
+    }
+};
+
+/**
+ * Замеры производительности (запускаются из командной строки).
+ */
+class Benchmarks
+{
+public:
+    /**
+     * Пропускная способность и задержка внешнего вычислителя: threads
+     * потоков делают по calls запросов к стандартному вычислителю
+     * (эта же программа с ключом --evaluator), delay - мкс на сообщение,
+     * limit - предел точек, ожидающих ответа.
+     */
+    static void external(const std::string& self, int threads, int calls,
+        int delay, size_t limit)
+    {
+        externalImpl(self, threads, calls, delay, limit);
+    }
+    /**
+     * Стоимость одного решения золотым сечением в зависимости от
+     * точности: до 15 знаков - double, до 30 - DoubleDouble, дальше -
+     * Quad. Многочлены тоже решаются итерациями, а не по формулам.
+     * Каждое решение повторяется, пока не наберётся 50 мс.
+     */
+    static void digits(const Function& fun, double a, double b)
+    {
+        std::cout << "Функция " << fun.getName() << " на [" << a << ';' << b
+            << ']' << std::endl
+            << "знаков  итераций  мкс/решение  мкс/знак" << std::endl;
+        double prevTime = 0.0;
+        int prevDigits = 0;
+        int levels[] = { 5, 10, 15, 20, 25, 30, 33 };
+        for (int prec : levels) {
+            Problem prob;
+            int runs = 0;
+            auto start = std::chrono::steady_clock::now();
+            double total = 0.0;
+            try {
+                do {
+                    // новая задача, чтобы не продолжать прошлое решение
+                    prob = Problem();
+                    prob.setBounds(a, b);
+                    prob.setPrecision(prec);
+                    prob.setClosedForm(false);
+                    prob.solve(fun);
+                    ++runs;
+                    total = std::chrono::duration<double, std::micro>(
+                        std::chrono::steady_clock::now() - start).count();
+                } while (total < 50000.0);
+            }
+            catch (std::exception& ex) {
+                std::cout << std::setw(6) << prec << "  " << ex.what() << std::endl;
+                continue;
+            }
+            double per = total / runs;
+            std::cout << std::setw(6) << prec << std::setw(10)
+                << prob.getIterations() << std::setw(13) << std::setprecision(4)
+                << per << std::setw(10);
+            if (prevDigits > 0)
+                std::cout << (per - prevTime) / (prec - prevDigits);
+            else
+                std::cout << '-';
+            std::cout << std::endl;
+            prevTime = per;
+            prevDigits = prec;
+        }
+    }
+    /**
+     * Поэтапный поиск против золотого сечения в double: сначала
+     * стоимость точки при вычислении пакетом в float и в double (нс,
+     * 4096 точек на [a;b], пока не наберётся 50 мс), затем среднее
+     * время решения до 10 знаков каждым способом.
+     */
+    static void staged(const Function& fun, double a, double b)
+    {
+        std::cout << "Функция " << fun.getName() << " на [" << a << ';' << b
+            << ']' << std::endl
+            << "пакет   нс/точку" << std::endl;
+        const size_t POINTS = 4096;
+        std::vector<float> xf(POINTS), yf(POINTS);
+        std::vector<double> xd(POINTS), yd(POINTS);
+        for (size_t i = 0; i < POINTS; ++i) {
+            xd[i] = a + (b - a) * i / (POINTS - 1);
+            xf[i] = float(xd[i]);
+        }
+        for (int pass = 0; pass < 2; ++pass) {
+            size_t points = 0;
+            double sum = 0.0;
+            auto start = std::chrono::steady_clock::now();
+            double us = 0.0;
+            do {
+                if (pass == 0) {
+                    fun.calcValues(xf.data(), yf.data(), POINTS);
+                    sum += yf[POINTS / 2];
+                }
+                else {
+                    fun.calcValues(xd.data(), yd.data(), POINTS);
+                    sum += yd[POINTS / 2];
+                }
+                points += POINTS;
+                us = std::chrono::duration<double, std::micro>(
+                    std::chrono::steady_clock::now() - start).count();
+            } while (us < 50000.0);
+            std::cout << (pass == 0 ? "float " : "double") << std::setw(11)
+                << std::setprecision(4) << us * 1000.0 / points
+                << (sum == sum ? "" : " NaN") << std::endl;
+        }
+        std::cout << "способ       мкс/решение  вычислений" << std::endl;
+        const int runs = 200;
+        for (int pass = 0; pass < 2; ++pass) {
+            Problem prob;
+            auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < runs; ++i) {
+                prob = Problem();
+                prob.setBounds(a, b);
+                prob.setPrecision(10);
+                prob.setClosedForm(false);
+                prob.setMethod(pass == 0 ? Problem::METHOD_STAGED
+                    : Problem::METHOD_GOLDEN);
+                prob.solve(fun);
+            }
+            double us = std::chrono::duration<double, std::micro>(
+                std::chrono::steady_clock::now() - start).count() / runs;
+            std::cout << (pass == 0 ? "поэтапный  " : "золотое    ")
+                << std::setw(13) << std::setprecision(4) << us
+                << std::setw(12) << prob.getEvaluations() << std::endl;
+        }
+    }
+    /**
+     * Упреждающие вычисления против обычного золотого сечения для
+     * функции, каждое значение которой стоит delay мкс: среднее время
+     * решения и кол-во вычислений (по 20 решений каждым способом).
+     */
+    static void speculative(const Function& fun, double a, double b, int delay)
+    {
+        SlowFunction slow(fun, delay);
+        std::cout << "Функция " << fun.getName() << " на [" << a << ';' << b
+            << "], " << delay << " мкс на значение" << std::endl
+            << "способ       мс/решение  вычислений" << std::endl;
+        const int runs = 20;
+        for (int pass = 0; pass < 2; ++pass) {
+            Problem prob;
+            auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < runs; ++i) {
+                prob = Problem();
+                prob.setBounds(a, b);
+                prob.setPrecision(10);
+                prob.setSpeculative(pass == 1);
+                prob.solve(slow);
+            }
+            double ms = std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - start).count() / runs;
+            std::cout << (pass == 1 ? "упреждающий" : "обычный    ")
+                << std::setw(13) << std::setprecision(4) << ms
+                << std::setw(12) << prob.getEvaluations() << std::endl;
+        }
+    }
+    /**
+     * Слежение за минимумом семейства fam при p = t, t от 0 до t1 за
+     * ticks шагов, в сравнении с полным решением на каждом шаге. Шаги,
+     * где полное решение не удалось или нашло другой локальный
+     * минимум, считаются отдельно, расхождение - по совпавшим.
+     */
+    static void tracking(const ParametricFunction& fam, double t1, int ticks)
+    {
+        const double a = -10.0, b = 10.0;
+        MinimumTracker tracker(fam, a, b, 1e-5);
+        std::vector<double> found(ticks);
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < ticks; ++i)
+            found[i] = tracker.update(t1 * i / ticks);
+        double trackTime = std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - start).count();
+        int full = 0, failed = 0, agreed = 0, differed = 0;
+        double diff = 0.0;
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < ticks; ++i) {
+            BoundFunction fun(fam, t1 * i / ticks);
+            Problem prob;
+            prob.setBounds(a, b);
+            prob.setPrecision(5);
+            try {
+                prob.solve(fun);
+                // локальных минимумов может быть несколько
+                double d = fabs(prob.getX() - found[i]);
+                if (d < 1e-3) {
+                    ++agreed;
+                    diff = std::max(diff, d);
+                }
+                else
+                    ++differed;
+                full += prob.getEvaluations();
+            }
+            catch (MyError&) {
+                ++failed;
+            }
+        }
+        double fullTime = std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - start).count();
+        std::cout << "Семейство " << fam.getName() << ", t от 0 до " << t1
+            << ", шагов: " << ticks << std::endl
+            << "Слежение: " << double(tracker.getEvaluations()) / ticks
+            << " вычислений/шаг, " << trackTime << " мс, расширений окна: "
+            << tracker.getWidenings() << std::endl
+            << "Полное решение: " << double(full) / std::max(1, ticks - failed)
+            << " вычислений/шаг, " << fullTime << " мс, не решено: "
+            << failed << std::endl
+            << "Сравнено шагов: " << agreed + differed << " из " << ticks
+            << ", совпали (до 1e-3): " << agreed << ", другой минимум: "
+            << differed << ", не сравнено: " << failed << std::endl
+            << "Наибольшее расхождение совпавших минимумов: ";
+        if (agreed > 0)
+            std::cout << diff << std::endl;
+        else
+            std::cout << '-' << std::endl;
+    }
+    /**
+     * Замена определения функции во время решений в другом потоке:
+     * решения идут без пауз и блокировок, старые версии удаляются,
+     * когда их решения закончились.
+     */
+    static void reload(int versions)
+    {
+        FunctionRegistry registry;
+        bool family = false;
+        int id = registry.define("f", "(x - 0.5)^2", family);
+        std::atomic<bool> stop(false);
+        std::atomic<int> solves(0), wrong(0);
+        std::thread solver([&] {
+            Problem prob;
+            prob.setBounds(-1.0, 2.0);
+            while (!stop.load()) {
+                auto pin = registry.pin();
+                const Function& fun = registry.get(id);
+                prob.solve(fun);
+                // минимум версии k - в точке 0.5 + k / 10000
+                double x = prob.getX();
+                if ((x < 0.5 - 1e-4) || (x > 0.5 + versions / 10000.0 + 1e-4))
+                    ++wrong;
+                ++solves;
             }
-            if (fabs(b - a) < epsilon)
-            {
-                x = (a + b) / 2;
-                return;
+        });
+        auto start = std::chrono::steady_clock::now();
+        for (int k = 1; k <= versions; ++k) {
+            std::ostringstream text;
+            text.imbue(std::locale::classic());
+            text << "(x - " << std::setprecision(17) << 0.5 + k / 10000.0 << ")^2";
+            registry.define("f", text.str(), family);
+        }
+        double ms = std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - start).count();
+        stop.store(true);
+        solver.join();
+        std::cout << "Замен функции: " << versions << " за " << ms << " мс"
+            << std::endl
+            << "Решений во время замен: " << solves.load() << ", неверных: "
+            << wrong.load() << std::endl
+            << "Старых версий удалено: " << registry.getReclaimed()
+            << ", ожидают: " << registry.getRetired() << std::endl
+            << "Текущая версия: " << registry.getRevision(id) << std::endl;
+    }
+    /**
+     * Скорость разбора и компиляции (значение и производные) count
+     * небольших выражений и кол-во выделений памяти в куче (только в
+     * сборке с COUNT_ALLOCATIONS): с отдельными выделениями на каждый
+     * узел и команду, в арене и при создании функций (через кэш
+     * компиляции). Различных выражений - distinct, каждое записано
+     * по-разному (пробелы, порядок операндов).
+     */
+    static void compile(int count, int distinct)
+    {
+        std::vector<std::string> texts(count);
+        for (int i = 0; i < count; ++i) {
+            int j = i % distinct;
+            std::ostringstream oss;
+            oss.imbue(std::locale::classic());
+            double a = 0.5 + j % 97 * 0.01, k = j % 1000 * 0.001;
+            int b = 1 + j % 13, c = 2 + j % 7;
+            if (i % 3 == 0)
+                oss << a << "*x^2 + " << b << "*sin(" << c << "*x) - " << k;
+            else if (i % 3 == 1)
+                oss << b << "*sin(x*" << c << ")+x^2*" << a << "-" << k;
+            else
+                oss << "  " << a << " * x ^ 2 + sin( " << c << " * x ) * " << b
+                    << " - " << k;
+            texts[i] = oss.str();
+        }
+        std::cout << "Выражений: " << count << ", например " << texts[0]
+            << std::endl
+            << "память  мкс/выражение  выделений/выражение  контрольная сумма"
+            << std::endl;
+        for (int pass = 0; pass < 3; ++pass) {
+            double sum = 0.0;
+#ifdef COUNT_ALLOCATIONS
+            uint64_t before = heapAllocations.load();
+#endif
+            auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < count; ++i) {
+                if (pass == 0) {
+                    Expression e(texts[i]);
+                    Program prog(e);
+                    Program derivs = Program::derivatives(e);
+                    double d[3];
+                    derivs.evalAll(1.0, 0.0, d);
+                    sum += prog.eval(1.0, 0.0) + d[2];
+                }
+                else if (pass == 1) {
+                    Arena arena(2048);
+                    Expression e(texts[i], Expression::Resolver(), &arena);
+                    Program prog(e, &arena);
+                    Program derivs = Program::derivatives(e, &arena);
+                    double d[3];
+                    derivs.evalAll(1.0, 0.0, d);
+                    sum += prog.eval(1.0, 0.0) + d[2];
+                }
+                else {
+                    ExpressionFunction fun(texts[i]);
+                    double d[3] = { 0.0, 0.0, 0.0 };
+                    fun.calcDerivatives(1.0, d);
+                    sum += d[0] + d[2];
+                }
             }
+            double us = std::chrono::duration<double, std::micro>(
+                std::chrono::steady_clock::now() - start).count();
+            static const char* NAMES[] = { "куча  ", "арена ", "функция" };
+            std::cout << NAMES[pass] << "  " << std::setw(13) << us / count
+                << "  " << std::setw(19)
+#ifdef COUNT_ALLOCATIONS
+                << double(heapAllocations.load() - before) / count
+#else
+                << '-'
+#endif
+                << "  " << std::setprecision(12) << sum << std::setprecision(6)
+                << std::endl;
         }
-        throw MyError("Достигнут предел кол-ва итераций!");
+#ifndef COUNT_ALLOCATIONS
+        std::cout << "Выделения памяти не считались: программа собрана без "
+            "COUNT_ALLOCATIONS" << std::endl;
+#endif
+        std::cout << CompileCache::instance().getMetricsString() << std::endl;
+    }
+
+private:
+
+    /**
+     * Дорогая функция для замеров: значения fun, на каждое из которых
+     * уходит delay мкс (активное ожидание, как при настоящем счёте).
+     */
+    class SlowFunction : public Function
+    {
+        const Function& fun;
+        int             delay;
+
+    public:
+        SlowFunction(const Function& inner, int us) :
+            Function(inner.getName().substr(4).c_str()), fun(inner), delay(us)
+        {
+        }
+    protected:
+        virtual double f(double x) const
+        {
+            auto until = std::chrono::steady_clock::now()
+                + std::chrono::microseconds(delay);
+            while (std::chrono::steady_clock::now() < until) {}
+            return fun.calcValue(x);
+        }
+    };
+
+    static void externalImpl(const std::string& self, int threads, int calls,
+        int delay, size_t limit)
+    {
+        ExternalFunction fun("'" + self + "' --evaluator 2 "
+            + std::to_string(delay), limit);
+        std::atomic<long long> total(0); // суммарная задержка, нс
+        auto start = std::chrono::steady_clock::now();
+        Parallel::forEach(threads, threads, [&](size_t t) {
+            for (int i = 0; i < calls; ++i) {
+                // часть точек совпадает между потоками
+                double x = ((i * 7 + t) % 1000) * 0.001;
+                auto t0 = std::chrono::steady_clock::now();
+                fun.calcValue(x);
+                total += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - t0).count();
+            }
+        });
+        double sec = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count();
+        double n = double(threads) * calls;
+        std::cout << "Потоков: " << threads << ", запросов: " << n << std::endl
+            << "Пропускная способность: " << n / sec << " запросов/с" << std::endl
+            << "Средняя задержка: " << total / n / 1000 << " мкс" << std::endl
+            << "Сообщений: " << fun.getBatches() << ", точек: "
+            << fun.getPoints() << ", слито одинаковых: " << fun.getMerged()
+            << std::endl;
     }
 };
 
 /**
- * Меню взаимодействия с пользователем.
+ * Самопроверка (--self-test): быстрые проверки решателей и разбора
+ * входных данных на задачах с известным ответом. Печатает
+ * непройденные проверки; если такие есть, бросает MyError.
  */
-class Menu
+class SelfTest
 {
-public:
+    int     checks;     // выполнено проверок
+    int     failures;   // из них не пройдено
+
+    SelfTest() : checks(0), failures(0) {}
+
     /**
-     * Коды команд.
+     * (x - 0.3)^2 или |x - 0.3| с подсчётом вычислений; на каждое
+     * значение уходит delay мкс.
      */
-    enum {
-        CMD_QUIT,
-        CMD_FUNC,
-        CMD_RANGE,
-        CMD_PRECISION,
-        CMD_SOLVE,
+    class CountingFunction : public Function
+    {
+        bool    sharp;  // |x - 0.3| вместо (x - 0.3)^2
+        int     delay;
 
-        CMD_COUNT
+    public:
+        mutable std::atomic<int> calls;
+
+        CountingFunction(bool corner = false, int us = 0) :
+            Function(corner ? "|x - 0.3|" : "(x - 0.3)^2"), sharp(corner),
+            delay(us), calls(0)
+        {
+        }
+    protected:
+        virtual double f(double x) const
+        {
+            ++calls;
+            auto until = std::chrono::steady_clock::now()
+                + std::chrono::microseconds(delay);
+            while (std::chrono::steady_clock::now() < until) {}
+            return sharp ? fabs(x - 0.3) : (x - 0.3) * (x - 0.3);
+        }
     };
 
-public:
+    void check(bool ok, const std::string& what)
+    {
+        ++checks;
+        if (!ok) {
+            ++failures;
+            std::cout << "Не пройдено: " << what << std::endl;
+        }
+    }
+    /**
+     * Функция, которая замечает вычисление после своего удаления:
+     * деструктор стирает метку.
+     */
+    class Canary : public Function
+    {
+        static const uint64_t MAGIC = 0x5AFE5AFE5AFE5AFEull;
+
+        volatile uint64_t magic;
 
+    public:
+        Canary() : Function("canary"), magic(MAGIC) {}
+        ~Canary() { magic = 0; }
+    protected:
+        virtual double f(double x) const
+        {
+            return magic == MAGIC ? x : std::numeric_limits<double>::quiet_NaN();
+        }
+    };
     /**
-     * Чтение строки с консоли.
+     * Временный файл с заданным содержимым, удаляется в деструкторе.
      */
-    static std::string readLine()
+    class TempFile
     {
-        std::string str;
-        std::getline(std::cin, str);
-        return str;
+        std::string path;
+
+    public:
+        explicit TempFile(const std::string& data)
+        {
+#ifdef _WIN32
+            char dir[MAX_PATH], name[MAX_PATH];
+            if (!GetTempPathA(MAX_PATH, dir) || !GetTempFileNameA(dir, "opt", 0, name))
+                throw MyError("Не удалось создать временный файл");
+            path = name;
+#else
+            char name[] = "/tmp/opttest-XXXXXX";
+            int fd = mkstemp(name);
+            if (fd < 0)
+                throw MyError("Не удалось создать временный файл");
+            close(fd);
+            path = name;
+#endif
+            std::ofstream out(path, std::ios::binary);
+            out.write(data.data(), data.size());
+        }
+        ~TempFile()
+        {
+            std::remove(path.c_str());
+        }
+        const std::string& getPath() const { return path; }
+    };
+    /**
+     * Содержимое табличного файла: заголовок с кол-вом отсчётов n и
+     * значения values.
+     */
+    static std::string tableData(uint64_t n, const std::vector<double>& values)
+    {
+        std::string data("TAB1\0\0\0\0", 8);
+        data.append(reinterpret_cast<const char*>(&n), sizeof(n));
+        data.append(reinterpret_cast<const char*>(values.data()),
+            values.size() * sizeof(double));
+        return data;
     }
     /**
-     * Перевод строки в число (в общем случае любой тип) T.
+     * Кэш значений не растёт больше предела и хранит последние значения.
      */
-    template< class T > static T parse(const std::string& str)
+    void evalCache()
     {
-        std::istringstream iss(str);
-        T retval;
-        iss >> retval;
-        if (iss.fail())
-            throw MyError("Ошибка ввода");
-        return retval;
+        Square fun;
+        EvalCache cache(100);
+        for (int i = 0; i < 1000; ++i)
+            cache.store(fun, i, double(i) * i);
+        double y = 0.0;
+        check(cache.getSize() == 100, "размер кэша значений ограничен");
+        check(cache.find(fun, 999, y) && (y == 999.0 * 999), "в кэше последние значения");
+        check(!cache.find(fun, 0, y), "старые значения вытеснены из кэша");
     }
     /**
-     * Пауза.
+     * Пул потоков выполняет каждую часть задания ровно один раз и
+     * передаёт исключения вызывающему.
      */
-    static void pause()
+    void workerPool()
     {
-        std::cout << "Нажмите <Enter>...";
-        readLine();
+        WorkerPool pool(4);
+        std::vector<std::atomic<int>> hits(1000);
+        for (auto& h : hits) h = 0;
+        for (int round = 0; round < 100; ++round)
+            pool.forEach(hits.size(), [&](size_t i) { ++hits[i]; });
+        bool once = true;
+        for (auto& h : hits) once = once && (h == 100);
+        check(once, "пул потоков выполняет каждую часть один раз");
+        bool caught = false;
+        try {
+            pool.forEach(10, [](size_t i) { if (i == 7) throw MyError("7"); });
+        }
+        catch (MyError&) {
+            caught = true;
+        }
+        check(caught, "пул потоков передаёт исключение");
+        Sin fun;
+        for (int threads = 1; threads <= 4; threads += 3) {
+            Problem prob;
+            prob.setBounds(-3.0, 0.0);
+            prob.setSpeculative(true);
+            prob.setThreads(threads);
+            prob.solve(fun);
+            check(fabs(prob.getX() + 1.5707963) < 1e-3, "упреждающее золотое сечение");
+        }
     }
+
     /**
-     * Ввод данных типа T.
+     * Решатели с обратной связью: пакетный прогон, серия задач одним
+     * пакетом и продолжение золотого сечения с прошлого отрезка.
      */
-    template< typename T > static T input(const char* prompt)
+    void steppers()
     {
-        std::cout << "Введите " << prompt << ": ";
-        return parse<T>(readLine());
+        Square square;
+        GoldenStepper a(-1.0, 2.0, 1e-8, Problem::ITERATION_LIMIT);
+        GoldenStepper b(-0.5, 3.0, 1e-8, Problem::ITERATION_LIMIT);
+        BrentStepper c(-1.0, 2.0, 1e-8, Problem::ITERATION_LIMIT);
+        int rounds = StepperDriver::run({ &a, &b, &c }, square);
+        check((fabs(a.result()) < 1e-7) && (fabs(b.result()) < 1e-7)
+            && (fabs(c.result()) < 1e-7), "пакетный прогон решателей");
+        check(rounds == std::max(a.getIterations(), b.getIterations()) + 2,
+            "пакетов столько, сколько шагов у самого долгого решателя");
+        ShiftedSquare fam;
+        Problem prob;
+        prob.setBounds(-1.0, 2.0);
+        prob.setPrecision(6);
+        std::vector<Problem::SweepPoint> batch = prob.sweepBatch(fam, -0.5, 1.5, 101);
+        std::vector<Problem::SweepPoint> warm = prob.sweep(fam, -0.5, 1.5, 101);
+        bool same = true;
+        for (size_t i = 0; i < batch.size(); ++i) {
+            same = same && (fabs(batch[i].x - batch[i].param) < 1e-5)
+                && (fabs(warm[i].x - batch[i].x) < 1e-5);
+        }
+        check(same, "серия задач одним пакетом");
+        Sin sine;
+        prob.setBounds(-3.0, 0.0);
+        prob.setPrecision(4);
+        prob.solve(sine);
+        prob.setPrecision(10);
+        prob.solve(sine);
+        check((fabs(prob.getX() + 1.5707963268) < 1e-6)
+            && (prob.getSolutionString().find("продолжение") != std::string::npos),
+            "продолжение золотого сечения с прошлого отрезка");
     }
+
     /**
-     * Выбор функции.
+     * Внешние вычислители (эта же программа с ключом --evaluator): два
+     * вычислителя сразу, предел ожидающих точек, закрытие в любом
+     * порядке и завершившийся вычислитель.
      */
-    static int readFunction(const Functions& funcs)
+    void external(const std::string& self)
     {
-        std::cout << "0] Назад" << std::endl;
-        for (int i = 0; i < funcs.getSize(); ++i) {
-            std::cout << (i + 1) << "] "
-                << funcs.get(i).getName() << std::endl;
+#ifndef _WIN32
+        std::unique_ptr<ExternalFunction> square(
+            new ExternalFunction("'" + self + "' --evaluator 1", 2));
+        std::unique_ptr<ExternalFunction> sine(
+            new ExternalFunction("'" + self + "' --evaluator 2"));
+        std::atomic<bool> right(true);
+        Parallel::forEach(4, 4, [&](size_t t) {
+            double xs[50], ys[50];
+            for (int i = 0; i < 50; ++i) xs[i] = t + i * 0.01;
+            square->calcValues(xs, ys, 50);
+            for (int i = 0; i < 50; ++i) {
+                if (ys[i] != xs[i] * xs[i]) right = false;
+            }
+        });
+        check(right && (sine->calcValue(1.0) == sin(1.0)),
+            "два внешних вычислителя, предел ожидающих точек");
+        double zeros[2] = { 0.0, -0.0 }, signs[2];
+        sine->calcValues(zeros, signs, 2);
+        check(!std::signbit(signs[0]) && std::signbit(signs[1]),
+            "-0.0 и 0.0 - разные запросы к вычислителю");
+        // сообщение с мусорным кол-вом точек закрывает обмен
+        int fds[2];
+        if (pipe(fds) == 0) {
+            uint32_t huge = 0xFFFFFFFFu;
+            bool written = write(fds[1], &huge, sizeof(huge)) == ssize_t(sizeof(huge));
+            close(fds[1]);
+            Square fun;
+            bool served = true;
+            try {
+                ExternalFunction::serve(fun, fds[0], -1, 0);
+            }
+            catch (std::exception&) {
+                served = false;
+            }
+            close(fds[0]);
+            check(written && served, "вычислитель отвергает неверное кол-во точек");
         }
-        while (true) {
-            std::cout << "Команда:> ";
-            int index = parse<int>(readLine());
-            if ((index >= 0) && (index <= funcs.getSize())) return index;
+        // первый вычислитель закрывается раньше второго: канал
+        // запросов первого не должен остаться открытым во втором
+        std::shared_ptr<std::promise<void>> closed = std::make_shared<std::promise<void>>();
+        std::future<void> done = closed->get_future();
+        ExternalFunction* first = square.release();
+        std::thread([first, closed] { delete first; closed->set_value(); }).detach();
+        check(done.wait_for(std::chrono::seconds(10)) == std::future_status::ready,
+            "закрытие внешнего вычислителя не ждёт другого");
+        sine.reset();
+        ExternalFunction dead("exit 0");
+        bool failed = false;
+        try {
+            for (int i = 0; i < 100; ++i)
+                dead.calcValue(double(i));
         }
+        catch (MyError&) {
+            failed = true;
+        }
+        check(failed, "завершившийся вычислитель - ошибка, а не SIGPIPE");
+#else
+        (void)self;
+#endif
     }
+
     /**
-     * Вывод меню и получение выбранной команды.
+     * Учёт всех вычислений функции (включая проверку наклонов на
+     * концах) и повторное решение после отмены.
      */
-    static int readSelection(const Function& f, const Problem& prob)
+    void budget()
     {
-        std::cout << CMD_QUIT << "] Выход из программы" << std::endl;
-        std::cout << CMD_FUNC << "] Выбор функции (выбрана: "
-            << f.getName() << ")" << std::endl;
-        std::cout << CMD_RANGE << "] Выбор отрезка (выбран: "
-            << prob.getBoundsString() << ")" << std::endl;
-        std::cout << CMD_PRECISION << "] Выбор точности (выбрана: "
-            << prob.getPrecisionString() << ")" << std::endl;
-        std::cout << CMD_SOLVE << "] Поиск минимума" << std::endl;
-        while (true) {
-            std::cout << "Команда:> ";
-            int index = parse<int>(readLine());
-            if ((index >= CMD_QUIT) && (index < CMD_COUNT)) return index;
-        }
+        CountingFunction fun;
+        Problem prob;
+        prob.setBounds(-1.0, 2.0);
+        prob.solve(fun);
+        check(prob.getEvaluations() == fun.calls, "учтены все вычисления функции");
+        prob.setMethod(Problem::METHOD_BRENT);
+        fun.calls = 0;
+        prob.solve(fun);
+        check(prob.getEvaluations() == fun.calls, "учтены все вычисления в методе Брента");
+        prob.getCancelToken().cancel();
+        prob.solve(fun);
+        check(!prob.isStopped() && (fabs(prob.getX() - 0.3) < 1e-4),
+            "решение после отмены прошлого");
     }
-};
 
-/**
- * Программа. Обработка ввода пользователя.
- */
-class App
-{
-    Functions   functions;  // набор функций
-    Problem     problem;    // параметры задачи
-    int         current;    // выбранная функция
+    /**
+     * Гонка методов: проигравшие (в том числе чебышёвская
+     * аппроксимация) останавливаются сразу после победы, отмена всего
+     * решения доходит до участников, вычисления идут через общий кэш.
+     */
+    void portfolio()
+    {
+        CountingFunction smooth;
+        Problem prob;
+        prob.setBounds(-1.0, 2.0);
+        prob.setMethod(Problem::METHOD_PORTFOLIO);
+        prob.solve(smooth);
+        check((fabs(prob.getX() - 0.3) < 1e-4)
+            && (prob.getEvaluations() == smooth.calls),
+            "гонка методов учитывает вычисления через общий кэш");
+        // аппроксимация |x| строится из десятков тысяч значений
+        CountingFunction corner(true, 100);
+        prob = Problem();
+        prob.setBounds(-1.0, 2.0);
+        prob.setMethod(Problem::METHOD_PORTFOLIO);
+        auto start = std::chrono::steady_clock::now();
+        prob.solve(corner);
+        double ms = std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - start).count();
+        check((fabs(prob.getX() - 0.3) < 1e-4) && (ms < 1000),
+            "проигравшие участники гонки останавливаются сразу");
+        CountingFunction slow(true, 1000);
+        prob = Problem();
+        prob.setBounds(-1.0, 2.0);
+        prob.setPrecision(12);
+        prob.setMethod(Problem::METHOD_PORTFOLIO);
+        bool stopped = false;
+        std::thread solver([&] {
+            try {
+                prob.solve(slow);
+                stopped = prob.isStopped();
+            }
+            catch (MyError&) {
+                stopped = true;
+            }
+        });
+        while (slow.calls < 4)
+            std::this_thread::yield();
+        prob.getCancelToken().cancel();
+        solver.join();
+        check(stopped, "отмена решения доходит до участников гонки");
+        // статистика - по номеру функции, а не по имени
+        RaceStats stats;
+        Square square;
+        ExpressionFunction same("x^2");
+        for (int i = 0; i < RaceStats::LEARN_RACES; ++i) {
+            stats.record(RaceStats::key(-1, square), Problem::METHOD_BRENT,
+                Problem::METHOD_COUNT);
+            stats.record(RaceStats::key(4, square), Problem::METHOD_NEWTON,
+                Problem::METHOD_COUNT);
+        }
+        check((stats.preferred(RaceStats::key(-1, square)) == Problem::METHOD_BRENT)
+            && (stats.preferred(RaceStats::key(-1, same)) < 0),
+            "одноимённые функции не делят статистику гонок");
+        check(stats.preferred(RaceStats::key(4, same)) == Problem::METHOD_NEWTON,
+            "новая версия функции сохраняет статистику гонок");
+        // победитель гонки - только с подтверждённым отрезком
+        ExpressionFunction wavy("sin(5*x) + 0.1*x^2");
+        prob = Problem();
+        prob.setBounds(-1.0, 0.5);
+        prob.setPrecision(8);
+        prob.setMethod(Problem::METHOD_PORTFOLIO);
+        prob.solve(wavy);
+        double at = prob.getX(), h = prob.getEpsilon() / 2;
+        check((wavy.calcValue(at) <= wavy.calcValue(at - h))
+            && (wavy.calcValue(at) <= wavy.calcValue(at + h)),
+            "ответ гонки подтверждён отрезком шириной eps");
+    }
 
-public:
+    /**
+     * Поэтапный поиск не теряет минимум, когда значения в float у
+     * нескольких точек совпадают (большое слагаемое-константа);
+     * пакетные вычисления в float совпадают с поточечными в double
+     * с точностью float.
+     */
+    void staged()
+    {
+        const size_t POINTS = 1000;
+        std::vector<float> xs(POINTS), ys(POINTS), zs(POINTS);
+        for (size_t i = 0; i < POINTS; ++i)
+            xs[i] = float(-100.0 + 200.0 * i / (POINTS - 1));
+        xs[1] = 3e5f;
+        xs[2] = -std::numeric_limits<float>::infinity();
+        xs[3] = std::numeric_limits<float>::quiet_NaN();
+        LaneMath::sin(xs.data(), ys.data(), POINTS);
+        LaneMath::cos(xs.data(), zs.data(), POINTS);
+        double worst = 0.0;
+        for (size_t i = 4; i < POINTS; ++i) {
+            worst = std::max(worst, std::fabs(ys[i] - std::sin(double(xs[i]))));
+            worst = std::max(worst, std::fabs(zs[i] - std::cos(double(xs[i]))));
+        }
+        check((worst < 1e-7) && (ys[1] == std::sin(3e5f)) && (zs[1] == std::cos(3e5f))
+            && std::isnan(ys[2]) && std::isnan(ys[3]) && std::isnan(zs[3]),
+            "sin и cos пакетом в float");
+        ExpressionFunction mixed("0.5*x^2 + sin(3*x) - cos(x)*exp(-x/50) + abs(x)/(1 + x^2)");
+        mixed.calcValues(xs.data(), ys.data(), POINTS);
+        std::vector<double> xd(POINTS), yd(POINTS);
+        for (size_t i = 0; i < POINTS; ++i)
+            xd[i] = xs[i];
+        mixed.calcValues(xd.data(), yd.data(), POINTS);
+        bool close = true, same = true;
+        for (size_t i = 4; i < POINTS; ++i) {
+            double exact = mixed.calcValue(xd[i]);
+            close = close && (std::fabs(ys[i] - exact) <= 1e-5 * (1 + std::fabs(exact)));
+            same = same && (yd[i] == exact);
+        }
+        check(close && same, "выражение пакетом в float и double");
+        const char* texts[] = {
+            "10000 + (x - 0.3)^2", "100000 + (x - 0.3)^2", "1e6 + (x - 0.7)^2"
+        };
+        const double answers[] = { 0.3, 0.3, 0.7 };
+        for (int i = 0; i < 3; ++i) {
+            ExpressionFunction fun(texts[i]);
+            Problem prob;
+            prob.setBounds(-1.0, 1.0);
+            prob.setPrecision(6);
+            prob.setMethod(Problem::METHOD_STAGED);
+            prob.solve(fun);
+            check(fabs(prob.getX() - answers[i]) < 1e-4,
+                std::string("поэтапный поиск: ") + texts[i]);
+        }
+    }
+    /**
+     * Повышенная точность: печатаются только различимые знаки,
+     * большие |x| не упираются в предел итераций, функции без
+     * вычислений точнее double не принимаются.
+     */
+    void extended()
+    {
+        Sin sine;
+        Problem prob;
+        prob.setBounds(-3.0, 0.0);
+        prob.setPrecision(30);
+        prob.solve(sine);
+        std::string text = prob.getSolutionString();
+        size_t from = text.find("-1.");
+        size_t end = text.find(' ', from);
+        std::string shown = from == std::string::npos ? "" : text.substr(from, end - from);
+        int digits = int(shown.size()) - 3;
+        check((digits >= 14) && (digits < 30) && (shown
+            == (-Real<DoubleDouble>::pi() / DoubleDouble(2.0)).toString(digits)),
+            "при повышенной точности печатаются только различимые знаки");
+        prob.setBounds(996.0, 999.0);
+        bool solved = true;
+        try {
+            prob.solve(sine);
+        }
+        catch (MyError&) {
+            solved = false;
+        }
+        check(solved && (fabs(prob.getX() - 997.4556675147593) < 1e-12),
+            "повышенная точность при больших |x|");
+        ExpressionFunction shifted("(x - 1000.1)^2");
+        prob.setBounds(999.0, 1001.5);
+        prob.setPrecision(20);
+        bool refused = false;
+        try {
+            prob.solve(shifted);
+        }
+        catch (MyError&) {
+            refused = true;
+        }
+        check(refused, "функция без повышенной точности не решается на 20 знаков");
+    }
 
-    App() : functions(), problem(), current(0) {}
+    /**
+     * Общие подвыражения и свёртка констант в программе выражения не
+     * путают NaN с NaN и -0.0 с 0.0.
+     */
+    void programs()
+    {
+        ExpressionFunction nan1("(x-0.3)^2 + sqrt(-1)");
+        check(std::isnan(nan1.calcValue(0.5)), "константа NaN в сумме");
+        ExpressionFunction nan2("x + log(-1)");
+        check(std::isnan(nan2.calcValue(2.0)), "NaN не заменяется другой константой");
+        ExpressionFunction zero("1/(0*(-1))");
+        double y = zero.calcValue(0.0);
+        check(std::isinf(y) && (y < 0), "-0.0 не сливается с 0.0");
+        ExpressionFunction shared("sin(x)^2 + sin(x)^2 + 2*3");
+        check(fabs(shared.calcValue(1.0) - (2 * sin(1.0) * sin(1.0) + 6)) < 1e-15,
+            "общие подвыражения и свёртка констант");
+        ExpressionFunction square("2^2 + x + pi^2");
+        const double pi = 3.14159265358979323846;
+        check(square.calcValue(1.0) == 5.0 + pi * pi,
+            "свёртка константы в квадрате");
+    }
 
-private:
+    /**
+     * Минимумы чебышёвской аппроксимации: близкие корни производной в
+     * одной клетке прежней сетки и корень высокой кратности.
+     */
+    void chebyshev()
+    {
+        // f' = (x + 0.5)(x - 0.3)(x - 0.3001): минимумы -0.5 и 0.3001
+        auto close = [](const double* xs, double* ys, size_t n) {
+            const double a = -0.5, b = 0.3, c = 0.3001;
+            for (size_t i = 0; i < n; ++i) {
+                double x = xs[i];
+                ys[i] = x * x * x * x / 4 - (a + b + c) * x * x * x / 3
+                    + (a * b + a * c + b * c) * x * x / 2 - a * b * c * x;
+            }
+            return true;
+        };
+        std::vector<double> found =
+            ChebyshevProxy::build(close, -1.0, 1.0, 1e-12).findMinima();
+        check((found.size() == 2) && (fabs(found[0] + 0.5) < 1e-6)
+            && (fabs(found[1] - 0.3001) < 1e-6), "близкие корни производной");
+        auto flat = [](const double* xs, double* ys, size_t n) {
+            for (size_t i = 0; i < n; ++i)
+                ys[i] = std::pow(xs[i] - 0.3, 4);
+            return true;
+        };
+        found = ChebyshevProxy::build(flat, -1.0, 1.0, 1e-12).findMinima();
+        check((found.size() == 1) && (fabs(found[0] - 0.3) < 1e-3),
+            "кратный корень производной");
+    }
 
-    void selectFunction()
+    /**
+     * Объединение функций: значения совпадают с суммой, произведением
+     * и композицией частей, а текст результата разбирается в ту же
+     * функцию.
+     */
+    void combine()
     {
-        int funcid = Menu::readFunction(functions);
-        if (funcid > 0) {
-            current = funcid - 1;
-            std::cout << "Выбрана "
-                << functions.get(current).getName() << std::endl;
+        ExpressionFunction f("exp(x) + x");
+        ExpressionFunction g("x^2 - 1");
+        Square square;
+        const double at[] = { -1.5, 0.0, 0.7, 2.0 };
+        auto sum = Combine::sum(f, g);
+        auto product = Combine::product(f, g);
+        auto scaled = Combine::scale(-2.5, f);
+        auto composed = Combine::compose(f, g);
+        bool values = true;
+        for (double x : at) {
+            double fx = f.calcValue(x), gx = g.calcValue(x);
+            values = values && (fabs(sum->calcValue(x) - (fx + gx)) < 1e-12)
+                && (fabs(product->calcValue(x) - fx * gx) < 1e-12)
+                && (fabs(scaled->calcValue(x) + 2.5 * fx) < 1e-12)
+                && (fabs(composed->calcValue(x) - f.calcValue(gx)) < 1e-12);
         }
-        else {
-            std::cout << "Отмена" << std::endl;
+        check(values, "сумма, произведение, множитель и композиция функций");
+        check(composed->getName() == "y = exp((x^2 - 1)) + (x^2 - 1)",
+            "в тексте композиции заменяется только имя x");
+        bool same = true;
+        for (const auto& fun : { sum, product, scaled, composed }) {
+            ExpressionFunction parsed(fun->getName().substr(4));
+            for (double x : at)
+                same = same && (fabs(parsed.calcValue(x) - fun->calcValue(x)) < 1e-12);
         }
+        check(same, "текст объединённой функции задаёт её же");
+        auto mixed = Combine::sum(f, square);
+        check(fabs(mixed->calcValue(2.0) - (f.calcValue(2.0) + 4.0)) < 1e-12,
+            "объединение с встроенной функцией");
+        FunctionRegistry registry;
+        int first = registry.addUnique(Combine::sum(f, g));
+        int again = registry.addUnique(Combine::sum(f, g));
+        std::string key = registry.getKey(first);
+        registry.replace(key, std::make_shared<ExpressionFunction>("x"));
+        int other = registry.addUnique(Combine::sum(f, g));
+        check((again == first) && (other != first)
+            && (registry.getKey(other) == key + " #2"),
+            "повторное объединение выбирает уже добавленную функцию");
     }
+
     /**
-     * Смена  отрезка.
+     * Корни многочленов: каждая смена знака на сетке отрезка [-1;1]
+     * у 20000 случайных многочленов степени 2-10 содержит найденный
+     * корень; близкие корни не теряются.
      */
-    void selectRange()
+    void polynomials()
     {
-        std::cout << "Пустая строка оставит прежнее значение (в скобках)"
-            << std::endl;
-        double a = problem.getLeft(), b = problem.getRight();
-        std::cout << "Левая граница отрезка (" << a << "): ";
-        std::string s = Menu::readLine();
-        if (s.length() > 0) a = Menu::parse<double>(s);
-        std::cout << "Правая граница отрезка (" << b << "): ";
-        s = Menu::readLine();
-        if (s.length() > 0) b = Menu::parse<double>(s);
-        problem.setBounds(a, b);
-        std::cout << "Установлен отрезок "
-            << problem.getBoundsString() << std::endl;
+        std::mt19937 rng(50);
+        std::uniform_real_distribution<double> coef(-1.0, 1.0);
+        const int GRID = 200;
+        int missed = 0;
+        for (int k = 0; k < 20000; ++k) {
+            Polynomial::Coeffs c(3 + k % 9);    // степень 2-10
+            for (double& v : c) v = coef(rng);
+            Polynomial::Coeffs found = Polynomial::roots(c, -1.0, 1.0);
+            double xa = -1.0, ya = Polynomial::eval(c, xa);
+            for (int i = 1; i <= GRID; ++i) {
+                double xb = -1.0 + 2.0 * i / GRID, yb = Polynomial::eval(c, xb);
+                if ((ya < 0) != (yb < 0) && (ya != 0) && (yb != 0)) {
+                    bool inside = false;
+                    for (double x : found)
+                        inside = inside || ((x >= xa) && (x <= xb));
+                    if (!inside) ++missed;
+                }
+                xa = xb;
+                ya = yb;
+            }
+        }
+        check(missed == 0, "корни случайных многочленов");
+        // (x - r)(x - r - 1e-8)(x + 0.5): по дискриминанту Кардано
+        // оба близких корня теряются
+        bool close = true;
+        for (double r : { -0.7, 0.55 }) {
+            double r1 = r, r2 = r + 1e-8, r3 = -0.5;
+            Polynomial::Coeffs c = { -r1 * r2 * r3, r1 * r2 + r1 * r3 + r2 * r3,
+                -(r1 + r2 + r3), 1.0 };
+            Polynomial::Coeffs found = Polynomial::roots(c, -1.0, 1.0);
+            size_t at = r < r3 ? 0 : 1;
+            close = close && (found.size() == 3) && (fabs(found[at] - r1) < 5e-8)
+                && (fabs(found[at + 1] - r2) < 5e-8);
+        }
+        check(close, "близкие корни многочлена");
+        ExpressionFunction quartic("x^4 - 0.8*x^3 + 0.24*x^2 + 0.1*x");
+        Problem prob;
+        prob.setBounds(-1.0, 1.0);
+        prob.solve(quartic);
+        double exact = prob.getX();
+        check(prob.getIterations() == 0, "минимум многочлена по формулам");
+        prob.setClosedForm(false);
+        prob.solve(quartic);
+        check((prob.getIterations() > 0) && (fabs(prob.getX() - exact) < 1e-4),
+            "без формул многочлен решается итерациями");
     }
+
     /**
-     * Смена точности.
+     * Замена функции в реестре, пока другие потоки её вычисляют:
+     * ни один читатель не видит удалённую версию, а старые версии в
+     * итоге удаляются.
      */
-    void setPrecision()
+    void epochs()
     {
-        int prec = Menu::input<int>("точность (знаков после запятой)");
-        problem.setPrecision(prec);
-        std::cout << "Установлена точность "
-            << problem.getPrecisionString() << std::endl;
+        FunctionRegistry registry;
+        int id = registry.replace("canary", std::make_shared<Canary>());
+        std::atomic<bool> done(false);
+        std::atomic<int> bad(0);
+        std::vector<std::thread> readers;
+        for (int k = 0; k < 8; ++k) {
+            readers.emplace_back([&]() {
+                while (!done) {
+                    auto pin = registry.pin();
+                    const Function& fun = registry.get(id);
+                    for (int i = 0; i < 8; ++i) {
+                        if (fun.calcValue(double(i)) != i) ++bad;
+                        std::this_thread::yield();
+                    }
+                }
+            });
+        }
+        auto until = std::chrono::steady_clock::now()
+            + std::chrono::milliseconds(300);
+        while (std::chrono::steady_clock::now() < until)
+            registry.replace("canary", std::make_shared<Canary>());
+        done = true;
+        for (auto& t : readers)
+            t.join();
+        registry.pin();
+        check(bad == 0, "читатели не видят удалённых версий функции");
+        check(registry.getReclaimed() > 0, "замещённые версии удаляются");
     }
+
     /**
-     * Решение поиск минимума.
+     * Разбор табличных файлов: неверный заголовок и неупорядоченные x
+     * дают ошибку формата, а не выделение памяти по мусорному n.
      */
-    void solve()
+    void tables()
     {
+        TempFile good(tableData(3, { 0.0, 1.0, 2.0, 1.0, 0.0, 1.0 }));
+        TabulatedFunction fun("t", good.getPath(), false);
+        check(fun.calcValue(0.5) == 0.5, "табличная функция");
+        TempFile huge(tableData(uint64_t(1) << 60, { 0.0, 1.0, 2.0, 3.0 }));
+        TempFile repeated(tableData(3, { 0.0, 1.0, 1.0, 1.0, 0.0, 1.0 }));
+        TempFile unsorted(tableData(3, { 0.0, 2.0, 1.0, 1.0, 0.0, 1.0 }));
+        for (const TempFile* file : { &huge, &repeated, &unsorted }) {
+            bool rejected = false;
+            try {
+                TabulatedFunction bad("t", file->getPath(), false);
+            }
+            catch (MyError&) {
+                rejected = true;
+            }
+            check(rejected, "неверный табличный файл отвергается");
+        }
+        // x не возрастают внутри второго блока: видно при поиске в нём
+        std::vector<double> values(2 * 300);
+        for (int i = 0; i < 300; ++i) {
+            values[i] = i;
+            values[300 + i] = i % 7;
+        }
+        values[100] = values[99];
+        TempFile middle(tableData(300, values));
+        TabulatedFunction lazy("t", middle.getPath(), false);
+        bool rejected = false;
         try {
-            problem.findMinimum(functions.get(current));
-            std::cout << problem.getSolutionString() << std::endl;
+            lazy.calcValue(100.5);
         }
-        catch (std::exception& ex) {
-            std::cerr << "* " << ex.what() << std::endl;
+        catch (MyError&) {
+            rejected = true;
+        }
+        check((lazy.calcValue(10.5) == 3.5) && (lazy.calcValue(250.5) == 5.5)
+            && rejected, "x табличного файла проверяются по блокам");
+        rejected = false;
+        try {
+            ArraySearch::run(huge.getPath(), 0, 0, false);
+        }
+        catch (MyError&) {
+            rejected = true;
         }
+        check(rejected, "поиск в массиве отвергает неверный заголовок");
+        ArraySearch::Result found = ArraySearch::run(good.getPath(), 0, 0, false);
+        check(found.index == 1, "поиск минимума в столбце y таблицы");
     }
 
 public:
 
+    static void run(const std::string& self)
+    {
+        SelfTest test;
+        test.evalCache();
+        test.workerPool();
+        test.steppers();
+        test.external(self);
+        test.budget();
+        test.portfolio();
+        test.programs();
+        test.chebyshev();
+        test.combine();
+        test.polynomials();
+        test.epochs();
+        test.tables();
+        test.staged();
+        test.extended();
+        std::cout << "Проверок: " << test.checks << ", не пройдено: "
+            << test.failures << std::endl;
+        if (test.failures > 0)
+            throw MyError("Самопроверка не пройдена");
+    }
+};
+
+/**
+ * Разбор командной строки.
+ *   --evaluator N [задержка]   работать вычислителем функции N
+ *   --self-test                самопроверка решателей
+ *   --bench-digits [N]         стоимость цифр точности для функции N
+ *   --bench-staged [N]         поэтапный поиск (float -> double)
+ *                              против золотого сечения для функции N
+ *   --bench-speculative [N] [задержка]
+ *                              упреждающие вычисления для функции N
+ *                              со значением за задержку (мкс)
+ *   --bench-external [потоки] [запросы] [задержка] [предел]
+ *   --bench-track [N] [t] [шаги] слежение за минимумом семейства N
+ *   --bench-reload [N]         N замен функции во время решений
+ *   --bench-compile [N] [K]    компиляция N небольших выражений, из
+ *                              них различных - K (выделения памяти
+ *                              считаются в сборке с -DCOUNT_ALLOCATIONS)
+ *   --make-table файл N a b k  записать k отсчётов функции N на [a;b]
+ *   --argmin-file файл [от до] [--no-prefetch]
+ *                              минимум унимодального массива в файле
+ *   --window N [файл] [--follow]
+ *                              минимум по окну из N отсчётов потока
+ *   --external "команда"       добавить функцию с внешним вычислителем
+ *   --external-limit N         не больше N точек, ожидающих ответа
+ *                              вычислителя (для следующих --external)
+ *   --table имя=файл[:cubic]   добавить табличную функцию
+ *   --define имя=выражение     добавить функцию, заданную выражением
+ *   --plugin модуль            добавить функцию из модуля (.so/.dll)
+ *   --select имя               выбрать функцию по имени
+ */
+class CommandLine
+{
+public:
     /**
-     * Цикл обработки главного меню.
+     * Выполнение служебного режима. Возвращает false, если в аргументах
+     * его нет и нужно запускать меню.
      */
-    void run()
+    static bool runTool(const std::vector<std::string>& args,
+        const std::string& self)
     {
-        while (true) {
-            int cmd = Menu::readSelection(functions.get(current), problem);
-            switch (cmd) {
-            case Menu::CMD_FUNC:        selectFunction(); break;
-            case Menu::CMD_RANGE:       selectRange(); break;
-            case Menu::CMD_PRECISION:   setPrecision(); break;
-            case Menu::CMD_SOLVE:       solve(); break;
-            default: return;
+        if (args.empty())
+            return false;
+        if (args[0] == "--evaluator") {
+            FunctionRegistry funcs;
+            int index = args.size() > 1 ? Menu::parse<int>(args[1]) : 1;
+            int delay = args.size() > 2 ? Menu::parse<int>(args[2]) : 0;
+            ExternalFunction::serve(funcs.get(index - 1), 0, 1, delay);
+            return true;
+        }
+        if (args[0] == "--bench-digits") {
+            FunctionRegistry funcs;
+            int index = args.size() > 1 ? Menu::parse<int>(args[1]) : 2;
+            const Function& fun = funcs.get(index - 1);
+            if (index == 2)
+                Benchmarks::digits(fun, -3.0, 0.0);
+            else
+                Benchmarks::digits(fun, -1.0, 2.0);
+            return true;
+        }
+        if (args[0] == "--self-test") {
+            SelfTest::run(self);
+            return true;
+        }
+        if (args[0] == "--bench-staged") {
+            FunctionRegistry funcs;
+            int index = args.size() > 1 ? Menu::parse<int>(args[1]) : 2;
+            const Function& fun = funcs.get(index - 1);
+            if (index == 2)
+                Benchmarks::staged(fun, -3.0, 0.0);
+            else
+                Benchmarks::staged(fun, -1.0, 2.0);
+            return true;
+        }
+        if (args[0] == "--bench-speculative") {
+            FunctionRegistry funcs;
+            int index = args.size() > 1 ? Menu::parse<int>(args[1]) : 2;
+            int delay = args.size() > 2 ? Menu::parse<int>(args[2]) : 100;
+            if (delay < 0)
+                throw MyError("Неверные параметры");
+            const Function& fun = funcs.get(index - 1);
+            if (index == 2)
+                Benchmarks::speculative(fun, -3.0, 0.0, delay);
+            else
+                Benchmarks::speculative(fun, -1.0, 2.0, delay);
+            return true;
+        }
+        if ((args[0] == "--make-table") && (args.size() == 6)) {
+            FunctionRegistry funcs;
+            TabulatedFunction::write(args[1],
+                funcs.get(Menu::parse<int>(args[2]) - 1),
+                Menu::parse<double>(args[3]), Menu::parse<double>(args[4]),
+                Menu::parse<uint64_t>(args[5]));
+            return true;
+        }
+        if (args[0] == "--argmin-file") {
+            std::vector<std::string> rest(args.begin() + 1, args.end());
+            bool prefetch = true;
+            auto flag = std::find(rest.begin(), rest.end(), "--no-prefetch");
+            if (flag != rest.end()) {
+                prefetch = false;
+                rest.erase(flag);
             }
-            Menu::pause();
+            if ((rest.size() != 1) && (rest.size() != 3))
+                throw MyError("Ожидается --argmin-file файл [от до]");
+            uint64_t from = rest.size() > 1 ? Menu::parse<uint64_t>(rest[1]) : 0;
+            uint64_t to = rest.size() > 1 ? Menu::parse<uint64_t>(rest[2]) : 0;
+            ArraySearch::print(rest[0], from, to, prefetch);
+            return true;
+        }
+        if (args[0] == "--window") {
+            std::vector<std::string> rest(args.begin() + 1, args.end());
+            bool follow = false;
+            auto flag = std::find(rest.begin(), rest.end(), "--follow");
+            if (flag != rest.end()) {
+                follow = true;
+                rest.erase(flag);
+            }
+            if ((rest.size() != 1) && (rest.size() != 2))
+                throw MyError("Ожидается --window N [файл] [--follow]");
+            size_t window = Menu::parse<size_t>(rest[0]);
+            if (rest.size() == 1) {
+                WindowMinimum::run(window, stdin, follow);
+                return true;
+            }
+            FILE* in = fopen(rest[1].c_str(), "rb");
+            if (!in)
+                throw MyError("Не удалось открыть файл");
+            std::unique_ptr<FILE, int (*)(FILE*)> guard(in, fclose);
+            WindowMinimum::run(window, in, follow);
+            return true;
+        }
+        if (args[0] == "--bench-track") {
+            FunctionRegistry funcs;
+            int index = args.size() > 1 ? Menu::parse<int>(args[1]) : 1;
+            double t1 = args.size() > 2 ? Menu::parse<double>(args[2]) : 5.0;
+            int ticks = args.size() > 3 ? Menu::parse<int>(args[3]) : 1000;
+            if ((index < 1) || (index > funcs.getFamilyCount()) || (ticks < 1))
+                throw MyError("Неверные параметры");
+            Benchmarks::tracking(funcs.getFamily(index - 1), t1, ticks);
+            return true;
+        }
+        if (args[0] == "--bench-reload") {
+            Benchmarks::reload(args.size() > 1 ? Menu::parse<int>(args[1]) : 1000);
+            return true;
+        }
+        if (args[0] == "--bench-compile") {
+            int count = args.size() > 1 ? Menu::parse<int>(args[1]) : 1000000;
+            int distinct = args.size() > 2 ? Menu::parse<int>(args[2]) : count;
+            if ((count < 1) || (distinct < 1))
+                throw MyError("Неверные параметры");
+            Benchmarks::compile(count, distinct);
+            return true;
+        }
+        if (args[0] == "--bench-external") {
+            int threads = args.size() > 1 ? Menu::parse<int>(args[1]) : 8;
+            int calls = args.size() > 2 ? Menu::parse<int>(args[2]) : 1000;
+            int delay = args.size() > 3 ? Menu::parse<int>(args[3]) : 100;
+            size_t limit = args.size() > 4 ? Menu::parse<size_t>(args[4]) : 65536;
+            if (limit < 1)
+                throw MyError("Неверные параметры");
+            Benchmarks::external(self, threads, calls, delay, limit);
+            return true;
+        }
+        return false;
+    }
+    /**
+     * Применение параметров запуска к программе.
+     */
+    static void configure(App& app, const std::vector<std::string>& args)
+    {
+        size_t limit = 65536;   // для следующих --external
+        for (size_t i = 0; i < args.size(); ++i) {
+            if ((args[i] == "--external") && (i + 1 < args.size())) {
+                app.addExternal(args[++i], limit);
+            }
+            else if ((args[i] == "--external-limit") && (i + 1 < args.size())) {
+                limit = Menu::parse<size_t>(args[++i]);
+                if (limit < 1)
+                    throw MyError("Предел должен быть положительным");
+            }
+            else if ((args[i] == "--table") && (i + 1 < args.size())) {
+                std::string spec = args[++i];
+                size_t eq = spec.find('=');
+                if (eq == std::string::npos)
+                    throw MyError("Ожидается --table имя=файл[:cubic]");
+                std::string path = spec.substr(eq + 1);
+                bool cubic = false;
+                if ((path.size() > 6)
+                    && (path.compare(path.size() - 6, 6, ":cubic") == 0)) {
+                    cubic = true;
+                    path.resize(path.size() - 6);
+                }
+                app.addTable(spec.substr(0, eq), path, cubic);
+            }
+            else if ((args[i] == "--plugin") && (i + 1 < args.size())) {
+                app.addPlugin(args[++i]);
+            }
+            else if ((args[i] == "--define") && (i + 1 < args.size())) {
+                std::string spec = args[++i];
+                size_t eq = spec.find('=');
+                if (eq == std::string::npos)
+                    throw MyError("Ожидается --define имя=выражение");
+                app.define(spec.substr(0, eq), spec.substr(eq + 1));
+            }
+            else if ((args[i] == "--select") && (i + 1 < args.size())) {
+                app.selectByName(args[++i]);
+            }
+            else
+                throw MyError("Неизвестный параметр командной строки");
         }
     }
 };
@@ -460,7 +8346,11 @@ int main(int argc, char** argv)
 {
     try {
         setlocale(LC_ALL, "RUS");
+        std::vector<std::string> args(argv + 1, argv + argc);
+        if (CommandLine::runTool(args, argv[0]))
+            return 0;
         App app;
+        CommandLine::configure(app, args);
         app.run();
         return 0;
     }